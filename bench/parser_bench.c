@@ -0,0 +1,198 @@
+// Times parsing of a plain and a quote heavy line, and loading the plain
+// one from its stored form as the body of a loop does, and counts the
+// allocations made once the buffers have grown to fit them. Each is also
+// given as a multiple of only splitting the plain line into words, so a
+// slower lexer shows up whatever machine this runs on
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "../src/parser.h"
+#include "../src/buffers.h"
+#include "../src/stored.h"
+#include "../src/expand.h"
+
+#define ROUNDS 200000
+#define PLAIN_LINE "grep -n -e needle -e other file_one file_two file_three | " \
+                   "sort -k 2 -t colon | uniq -c | head -n 20 > out.txt"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+static size_t allocations;
+static double baseline; // ns/line to split the plain line into words
+
+void *__wrap_malloc(size_t size) {
+
+    allocations++;
+    return __real_malloc(size);
+
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+
+    allocations++;
+    return __real_calloc(n, size);
+
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+
+    allocations++;
+    return __real_realloc(p, size);
+
+}
+
+
+static double elapsed(const struct timespec *start, const struct timespec *end) {
+
+    return (end->tv_sec - start->tv_sec) * 1e9 +
+           (end->tv_nsec - start->tv_nsec);
+
+}
+
+
+// Splits a line at spaces and special characters, as the lexer did before
+// it knew of quotes, escapes or anything to expand. The least parsing the
+// line can take
+static size_t split_words(char *line, char **words) {
+
+    size_t count = 0;
+    char *c = line;
+    while (*c != '\0') {
+        while (isspace(*c)) {
+            c++;
+        }
+        if (*c == '\0') {
+            break;
+        }
+        words[count++] = c;
+        if (is_spec(*c)) {
+            c++;
+            continue;
+        }
+        while (*c != '\0' && !isspace(*c) && !is_spec(*c)) {
+            c++;
+        }
+        if (isspace(*c)) {
+            *c++ = '\0';
+        }
+    }
+    return count;
+
+}
+
+
+static void run_baseline(const char *name, const char *line) {
+
+    size_t len = strlen(line);
+    char *copy = malloc(len + 1);
+    char **words = malloc((len + 1) * sizeof(char *));
+    size_t count = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; ++i) {
+        memcpy(copy, line, len + 1);
+        count += split_words(copy, words);
+        // Keeps the compiler from leaving out the copy or the split
+        __asm__ volatile("" : : "r" (copy), "r" (words) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    baseline = elapsed(&start, &end) / ROUNDS;
+    printf("%-8s %4zu bytes %3zu items %8.1f ns/line %6.2f ns/byte\n",
+           name, len, count / ROUNDS, baseline, baseline / len);
+    free(words);
+    free(copy);
+
+}
+
+
+static void run(const char *name, const char *line, parsed_line *pl) {
+
+    size_t len = strlen(line);
+    char *copy = malloc(len + 1);
+    size_t tokens = 0;
+
+    // Once first, so the buffers are grown before measuring
+    memcpy(copy, line, len + 1);
+    if (parse(copy, pl) < 0) {
+        fprintf(stderr, "%s: parse failed\n", name);
+        exit(1);
+    }
+    for (command *cmd = pl->cmd; cmd; cmd = cmd->next) {
+        tokens += cmd->length;
+    }
+
+    size_t before = allocations;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; ++i) {
+        memcpy(copy, line, len + 1);
+        parse(copy, pl);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = elapsed(&start, &end) / ROUNDS;
+    printf("%-8s %4zu bytes %3zu items %8.1f ns/line %6.2f ns/byte "
+           "%5.1fx split %zu allocations\n", name, len, tokens, ns,
+           ns / len, ns / baseline, allocations - before);
+    free(copy);
+
+}
+
+
+static void run_stored(const char *name, const char *line, parsed_line *pl) {
+
+    size_t len = strlen(line);
+    char *copy = malloc(len + 1);
+    memcpy(copy, line, len + 1);
+    if (parse_raw(copy, pl) < 0) {
+        fprintf(stderr, "%s: parse failed\n", name);
+        exit(1);
+    }
+    stored_line *sl = store_line(pl);
+    load_line(sl, pl);
+    expand_line(pl);
+
+    size_t before = allocations;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; ++i) {
+        load_line(sl, pl);
+        expand_line(pl);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = elapsed(&start, &end) / ROUNDS;
+    printf("%-8s %4zu bytes %3u items %8.1f ns/line %6.2f ns/byte "
+           "%5.1fx split %zu allocations\n", name, len, sl->item_count, ns,
+           ns / len, ns / baseline, allocations - before);
+    free(sl);
+    free(copy);
+
+}
+
+
+int main() {
+
+    parsed_line pl;
+    if (init_buffers(&pl) < 0) {
+        return 1;
+    }
+
+    run_baseline("split", PLAIN_LINE);
+    run("plain", PLAIN_LINE, &pl);
+    run("quoted",
+        "grep -n -e 'needle here' -e \"other one\" file\\ one 'file two' "
+        "\"file three\" | sort -k 2 -t ':' | uniq -c | head -n '20' "
+        "> 'out file.txt'", &pl);
+    run_stored("stored", PLAIN_LINE, &pl);
+
+    free_buffers(&pl);
+    return 0;
+
+}
@@ -0,0 +1,164 @@
+// Times how long the shell takes from being started to having run its
+// first command, and to exiting after it, with input from a pipe as for
+// a script and from a terminal as for someone typing. Starting the same
+// command directly is timed too, for what no shell could save
+#define _GNU_SOURCE // posix_openpt and ptsname
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define ROUNDS 200
+
+// Typed with quotes, so the echo of the input is not taken for the output
+#define COMMAND "echo re''ady\n"
+#define READY   "ready"
+
+enum mode { DIRECT, SCRIPT, TERMINAL };
+
+static double since(const struct timespec *start) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 +
+           (now.tv_nsec - start->tv_nsec) / 1e6;
+
+}
+
+
+// Starts the shell, or echo itself, and waits for READY to come out.
+// Adds the times to the first command and to the exit to the totals
+static void start_once(const char *shell, enum mode mode,
+                       double *first, double *done) {
+
+    int in[2];
+    int out[2];
+    int term = -1;
+    if (mode == TERMINAL) {
+        term = posix_openpt(O_RDWR|O_NOCTTY);
+        if (term == -1 || grantpt(term) < 0 || unlockpt(term) < 0) {
+            perror("posix_openpt");
+            exit(1);
+        }
+        in[1] = out[0] = term;
+    } else if (pipe(in) < 0 || pipe(out) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (mode == TERMINAL) {
+            setsid();
+            int fd = open(ptsname(term), O_RDWR);
+            dup2(fd, 0);
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+            close(term);
+        } else {
+            dup2(in[0], 0);
+            dup2(out[1], 1);
+            close(in[0]);
+            close(in[1]);
+            close(out[0]);
+            close(out[1]);
+        }
+        if (mode == DIRECT) {
+            execlp("echo", "echo", READY, (char *) NULL);
+        } else {
+            execl(shell, shell, (char *) NULL);
+        }
+        exit(127);
+    }
+    if (mode != TERMINAL) {
+        close(in[0]);
+        close(out[1]);
+    }
+
+    if (mode != DIRECT && write(in[1], COMMAND, strlen(COMMAND)) < 0) {
+        perror("write");
+        exit(1);
+    }
+
+    char buf[4096];
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(out[0], buf + len, sizeof(buf) - 1 - len)) > 0) {
+        len += n;
+        buf[len] = '\0';
+        if (strstr(buf, READY)) {
+            break;
+        }
+        if (len > sizeof(buf) / 2) {
+            memmove(buf, buf + len - 8, 8);
+            len = 8;
+        }
+    }
+    *first += since(&start);
+
+    if (mode == TERMINAL) {
+        if (write(term, "exit\n", 5) < 0) {
+            perror("write");
+            exit(1);
+        }
+    } else {
+        close(in[1]);
+    }
+    // A terminal gives an error rather than the end once the shell is gone
+    while (read(out[0], buf, sizeof(buf)) > 0) {
+        ;
+    }
+    waitpid(pid, NULL, 0);
+    *done += since(&start);
+    close(out[0]);
+
+}
+
+
+static void run(const char *name, const char *shell, enum mode mode) {
+
+    double first = 0;
+    double done = 0;
+    for (int i = 0; i < ROUNDS; ++i) {
+        start_once(shell, mode, &first, &done);
+    }
+    printf("%-8s %8.3f ms to first command %8.3f ms to exit\n",
+           name, first / ROUNDS, done / ROUNDS);
+
+}
+
+
+int main(int argc, char **argv) {
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s shell\n", argv[0]);
+        return 1;
+    }
+
+    // The history is read at startup, so give the shell one of its own
+    char hist[] = "/tmp/startup_bench_XXXXXX";
+    int fd = mkstemp(hist);
+    if (fd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        dprintf(fd, "ls -l /some/directory/%d | grep pattern\n", i);
+    }
+    close(fd);
+    setenv("HISTFILE", hist, 1);
+
+    run("direct", argv[1], DIRECT);
+    run("script", argv[1], SCRIPT);
+    run("terminal", argv[1], TERMINAL);
+
+    unlink(hist);
+    return 0;
+
+}
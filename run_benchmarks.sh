@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+
+readonly BENCH_BIN="parser_bench_bin"
+gcc -O2 -o "$BENCH_BIN" bench/parser_bench.c src/parser.c src/buffers.c src/expand.c src/wildcard.c src/vars.c src/stored.c -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+./"$BENCH_BIN"
+rm "$BENCH_BIN"
+
+readonly STARTUP_BIN="startup_bench_bin"
+readonly SHELL_BIN="startup_bench_shell"
+gcc -O2 -o "$SHELL_BIN" src/*.c -lreadline -lpthread
+gcc -O2 -o "$STARTUP_BIN" bench/startup_bench.c
+./"$STARTUP_BIN" ./"$SHELL_BIN"
+rm "$STARTUP_BIN" "$SHELL_BIN"
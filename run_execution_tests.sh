@@ -3,7 +3,7 @@
 
 oneTimeSetUp() {
     readonly EXEC_BIN="exec_test_bin"
-    gcc -o "$EXEC_BIN" src/*.c -lreadline -I.
+    gcc -o "$EXEC_BIN" src/*.c -lreadline -lpthread -I.
 
     # Commands are fed to a named pipe
     readonly TEST_SHELL="bunsh_fifo_pipe"
@@ -77,6 +77,220 @@ testBackgroundProcessIsWaitedOn() {
 }
 
 
+testCompoundCommands() {
+    readonly LOOP_OUTPUT="loop_test_output"
+    readonly LOOP_FUNC='f() { for x in "$@"; do if [ $x != b ]; then echo $x; fi; done; }'
+
+    echo "$LOOP_FUNC; f a b c > $LOOP_OUTPUT" > "$TEST_SHELL"
+
+    waitForFileOutput "$LOOP_OUTPUT"
+
+    diff "$LOOP_OUTPUT" <(printf 'a\nc\n')
+    assertTrue $?
+
+    rm "$LOOP_OUTPUT"
+}
+
+
+testGroups() {
+    readonly GROUP_OUTPUT="group_test_output"
+
+    # The output only gets its name once the whole group is done
+    echo "{ echo a; (echo b; echo c) | tr a-z A-Z; } > $GROUP_OUTPUT.part; mv $GROUP_OUTPUT.part $GROUP_OUTPUT" > "$TEST_SHELL"
+
+    waitForFileOutput "$GROUP_OUTPUT"
+
+    diff "$GROUP_OUTPUT" <(printf 'a\nB\nC\n')
+    assertTrue $?
+
+    rm "$GROUP_OUTPUT"
+}
+
+
+testBuiltinStatusInCondition() {
+    readonly BUILTIN_OUTPUT="builtin_test_output"
+
+    # cd fails, so the else branch runs and $? is its status
+    echo "{ if cd /nonexistent; then echo then; else echo else; fi; cd /nonexistent; echo \$?; } > $BUILTIN_OUTPUT.part; mv $BUILTIN_OUTPUT.part $BUILTIN_OUTPUT" > "$TEST_SHELL"
+
+    waitForFileOutput "$BUILTIN_OUTPUT"
+
+    diff "$BUILTIN_OUTPUT" <(printf 'else\n1\n')
+    assertTrue $?
+
+    rm "$BUILTIN_OUTPUT"
+}
+
+
+testBuiltinInPipeline() {
+    readonly PIPED_OUTPUT="piped_builtin_test_output"
+
+    # A builtin that is not the only command runs in a child of its own
+    printf '%s\n' 'alias hi="echo hi"' 'alias | tr a-z A-Z' \
+        'echo x | cd /nonexistent' 'echo $?' \
+        | ./"$EXEC_BIN" > "$PIPED_OUTPUT" 2>&1
+
+    diff "$PIPED_OUTPUT" <(printf '%s\n' "ALIAS HI='ECHO HI'" 'Unknown path: /nonexistent' 1)
+    assertTrue $?
+
+    rm "$PIPED_OUTPUT"
+}
+
+
+testLineCacheKeepsRecentLines() {
+    readonly CACHE_OUTPUT="line_cache_test_output"
+
+    # A line run again is a hit until 256 others push it out, and
+    # redefining an alias empties the cache while a function called from
+    # a cached line runs its new body
+    {
+        printf '%s\n' 'x=1' 'x=1' 'linecache'
+        seq -f 'y=%g' 256
+        printf '%s\n' 'x=1' 'y=256' 'linecache' \
+            'alias g="echo one"' 'g' 'alias g="echo two"' 'g' \
+            'f() { echo one; }' 'f' 'f() { echo two; }' 'f' 'linecache'
+    } | ./"$EXEC_BIN" > "$CACHE_OUTPUT" 2>&1
+
+    diff "$CACHE_OUTPUT" <(printf '%s\n' \
+        '1 hits, 2 misses, 2 of 256 lines cached' \
+        '2 hits, 260 misses, 256 of 256 lines cached' \
+        one two one two '3 hits, 268 misses, 5 of 256 lines cached')
+    assertTrue $?
+
+    rm "$CACHE_OUTPUT"
+}
+
+
+testUlimitLimitsJobs() {
+    readonly ULIMIT_OUTPUT="ulimit_test_output"
+    readonly OPEN_FILES=$(ulimit -n)
+
+    # Inline limits only apply to their own line, the builtin to every
+    # job after it, and a negative limit leaves the limits as they were
+    printf '%s\n' 'ulimit -n 64 sh -c "ulimit -n" | cat' 'sh -c "ulimit -n"' \
+        'ulimit -n 32' 'ulimit -n -5' 'ulimit -n' 'sh -c "ulimit -n"' \
+        | ./"$EXEC_BIN" > "$ULIMIT_OUTPUT" 2>&1
+
+    diff "$ULIMIT_OUTPUT" <(printf '64\n%s\nulimit: bad limit -5\n32\n32\n' "$OPEN_FILES")
+    assertTrue $?
+
+    rm "$ULIMIT_OUTPUT"
+}
+
+
+testCommandNamesComplete() {
+    readonly COMPLETE_OUTPUT="complete_test_output"
+    readonly COMPLETE_DIR="complete_test_path"
+
+    mkdir "$COMPLETE_DIR"
+    printf '#!/bin/sh\necho ran-executable\n' > "$COMPLETE_DIR/cmpl_exec"
+    chmod +x "$COMPLETE_DIR/cmpl_exec"
+
+    # Readline only completes on a terminal, which script provides. Each
+    # name is typed up to a tab, which has to complete it for it to run.
+    # The sleep gives the index time to take in the directory
+    printf '%s\n' 'sleep 1' 'cmpl_fn() { echo ran-function; }' \
+        'alias cmpl_al="echo ran-alias"' $'true; cmpl_f\t' \
+        $'if true; then cmpl_a\t; fi' $'{ cmpl_f\t; }' $'true | cmpl_e\t' \
+        $'echo then cmpl_\t' exit \
+        | PATH="$PWD/$COMPLETE_DIR:$PATH" HISTFILE="$COMPLETE_OUTPUT.hist" \
+          script -qc ./"$EXEC_BIN" /dev/null > "$COMPLETE_OUTPUT"
+
+    assertEquals 2 "$(grep -ac $'\rran-function\r' "$COMPLETE_OUTPUT")"
+    assertEquals 1 "$(grep -ac $'\rran-alias\r' "$COMPLETE_OUTPUT")"
+    assertEquals 1 "$(grep -ac $'\rran-executable\r' "$COMPLETE_OUTPUT")"
+    # An argument is not a command name, so it is not completed as one
+    assertEquals 1 "$(grep -ac $'\rthen cmpl_\r' "$COMPLETE_OUTPUT")"
+
+    rm -r "$COMPLETE_OUTPUT" "$COMPLETE_OUTPUT.hist" "$COMPLETE_DIR"
+}
+
+
+testPipestatReportsEachPipe() {
+    readonly PIPESTAT_OUTPUT="pipestat_test_output"
+
+    # The report goes to stderr, so this shell is run on its own
+    echo "pipestat seq 1000 | cat | wc -l > /dev/null" | ./"$EXEC_BIN" > /dev/null 2> "$PIPESTAT_OUTPUT"
+
+    assertEquals 2 "$(grep -c '^pipestat: [12] ' "$PIPESTAT_OUTPUT")"
+    assertEquals 1 "$(grep -c '^pipestat: 2 cat | wc: 3893 bytes, 1000 lines' "$PIPESTAT_OUTPUT")"
+
+    rm "$PIPESTAT_OUTPUT"
+}
+
+
+testServerSendsOutputAndStatus() {
+    readonly SERVER_SOCKET="bunsh_test_socket"
+
+    ./"$EXEC_BIN" --serve "$SERVER_SOCKET" 2> /dev/null &
+    readonly SERVER_PID=$!
+    while [ ! -S "$SERVER_SOCKET" ]; do
+        sleep 0.1
+    done
+
+    # Only the user running the server may connect
+    assertEquals 600 "$(stat -c %a "$SERVER_SOCKET")"
+
+    # A second server leaves the socket of a live one alone
+    ./"$EXEC_BIN" --serve "$SERVER_SOCKET" 2> /dev/null
+    assertFalse $?
+
+    # Sends a line and prints the frames that come back, one per line
+    frames="$(python3 - "$SERVER_SOCKET" <<'EOF'
+import socket, struct, sys
+
+sock = socket.socket(socket.AF_UNIX)
+sock.connect(sys.argv[1])
+line = b"echo hello; false"
+sock.sendall(b"L" + struct.pack(">I", len(line)) + line)
+
+def read(n):
+    data = b""
+    while len(data) < n:
+        data += sock.recv(n - len(data))
+    return data
+
+while True:
+    kind, n = struct.unpack(">cI", read(5))
+    payload = read(n)
+    if kind == b"S":
+        print("S", struct.unpack(">I", payload)[0])
+        break
+    print(kind.decode(), payload.decode().rstrip("\n"))
+EOF
+)"
+    assertEquals "$(printf 'O hello\nS 1')" "$frames"
+
+    kill "$SERVER_PID"
+    rm "$SERVER_SOCKET"
+}
+
+
+testZygotesRunPipelines() {
+    readonly ZYGOTE_OUTPUT="zygote_test_output"
+
+    echo "BUNSH_ZYGOTES=2" > "$TEST_SHELL"
+
+    # A command taken by a zygote keeps the pid the zygote was started with
+    while [ "$(pgrep -c -P "$SHELL_PID" -xf "bunsh --zygote")" -lt 2 ]; do
+        sleep 0.1
+    done
+    ZYGOTE_PIDS="$(pgrep -P "$SHELL_PID" -xf "bunsh --zygote")"
+
+    echo "sh -c 'echo started \$\$' | tr a-z A-Z > $ZYGOTE_OUTPUT" > "$TEST_SHELL"
+
+    waitForFileOutput "$ZYGOTE_OUTPUT"
+
+    read -r word pid < "$ZYGOTE_OUTPUT"
+    assertEquals "STARTED" "$word"
+    echo "$ZYGOTE_PIDS" | grep -qx "$pid"
+    assertTrue "the command did not run in a zygote" $?
+
+    echo "BUNSH_ZYGOTES=0" > "$TEST_SHELL"
+    rm "$ZYGOTE_OUTPUT"
+}
+
+
 # Returns when the file given by the first parameter has been created and written to
 waitForFileOutput() {
     file="$1"
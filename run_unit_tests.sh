@@ -1,6 +1,6 @@
 #!/usr/bin/env bash
 
 readonly UNIT_BIN="unit_test_bin"
-gcc -o "$UNIT_BIN" test/cunit_runner.c test/parser_suite.c src/parser.c src/buffers.c -lcunit -I.
+gcc -o "$UNIT_BIN" test/cunit_runner.c test/parser_suite.c test/wildcard_suite.c test/vars_suite.c test/stored_suite.c test/workdir_suite.c test/histfile_suite.c src/parser.c src/buffers.c src/expand.c src/wildcard.c src/vars.c src/stored.c src/workdir.c src/histfile.c -lcunit -I.
 ./"$UNIT_BIN" 2> /dev/null
 rm "$UNIT_BIN"
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include <stdlib.h>
+#include <string.h>
 #include "buffers.h"
 #include "parser.h"
 
 #define CMD_BUF_SIZE    8 * sizeof(command)
 #define ITEM_BUF_SIZE  32 * sizeof(char *)
+#define STR_CHUNK_SIZE 4096
 
 
 // Allocates memory for the parse structure's buffers
@@ -14,8 +16,19 @@ int init_buffers(parsed_line *pl) {
 
     static item_buffer item_buf;
     item_buf.start = malloc(ITEM_BUF_SIZE);
+    item_buf.flags = malloc(ITEM_BUF_SIZE / sizeof(char *));
 
-    if (cmd_buf.start == NULL || item_buf.start == NULL) {
+    // Holds the items of a line after expansion
+    static item_buffer exp_buf;
+    exp_buf.start = malloc(ITEM_BUF_SIZE);
+    exp_buf.flags = NULL;
+
+    static string_buffer str_buf;
+    str_buf.chunk = NULL;
+    str_buf.used  = 0;
+
+    if (cmd_buf.start == NULL || item_buf.start == NULL ||
+        item_buf.flags == NULL || exp_buf.start == NULL) {
         return -1;
     }
 
@@ -23,6 +36,9 @@ int init_buffers(parsed_line *pl) {
     pl->cmd_buf = &cmd_buf;
     item_buf.size = ITEM_BUF_SIZE;
     pl->item_buf = &item_buf;
+    exp_buf.size = ITEM_BUF_SIZE;
+    pl->exp_buf = &exp_buf;
+    pl->str_buf = &str_buf;
 
     return 0;
 
@@ -37,26 +53,32 @@ int check_buffers(parsed_line *pl, size_t item_count, size_t pipe_count) {
     // The number of commands is one more than the number of pipes
     size_t want_size  = (pipe_count + 1) * sizeof(command);
     if (want_size > curr_size) {
-        pl->cmd_buf->start = realloc(pl->cmd_buf->start,
-                                     want_size);
-
-        if (pl->cmd_buf->start == NULL) {
+        command *start = realloc(pl->cmd_buf->start, want_size);
+        if (start == NULL) {
             return -1;
         }
+        pl->cmd_buf->start = start;
         pl->cmd_buf->size = want_size;
     }
 
     // Item buffer
     curr_size = pl->item_buf->size;
     // Each item list of each command ends with NULL
-    want_size = (item_count + pipe_count) * sizeof(char *);
+    want_size = (item_count + pipe_count + 1) * sizeof(char *);
     if (want_size > curr_size) {
-        pl->item_buf->start = realloc(pl->item_buf->start,
-                                      want_size);
-
-        if (pl->item_buf->start == NULL) {
+        // Each block is kept as soon as it has grown, since the old one
+        // is gone then, but the size only once both have
+        char **start = realloc(pl->item_buf->start, want_size);
+        if (start == NULL) {
+            return -1;
+        }
+        pl->item_buf->start = start;
+        unsigned char *flags = realloc(pl->item_buf->flags,
+                                       want_size / sizeof(char *));
+        if (flags == NULL) {
             return -1;
         }
+        pl->item_buf->flags = flags;
         pl->item_buf->size = want_size;
     }
 
@@ -64,8 +86,115 @@ int check_buffers(parsed_line *pl, size_t item_count, size_t pipe_count) {
 }
 
 
+// Makes sure an item buffer has room for count items
+int reserve_items(item_buffer *buf, size_t count) {
+
+    size_t want_size = count * sizeof(char *);
+    if (want_size <= buf->size) {
+        return 0;
+    }
+
+    // Expansion adds items one by one, so grow geometrically
+    if (want_size < 2 * buf->size) {
+        want_size = 2 * buf->size;
+    }
+    char **start = realloc(buf->start, want_size);
+    if (start == NULL) {
+        return -1;
+    }
+    buf->start = start;
+    buf->size = want_size;
+
+    return 0;
+
+}
+
+
+// Copies len characters of s into the string buffer and null terminates
+// the copy. Strings are never moved, so the copy stays valid until the
+// buffer is reset
+char *store_string(parsed_line *pl, const char *s, size_t len) {
+
+    string_buffer *sb = pl->str_buf;
+    string_chunk *chunk = sb->chunk;
+
+    if (chunk == NULL || sb->used + len + 1 > chunk->size) {
+        size_t size = STR_CHUNK_SIZE;
+        while (size < len + 1) {
+            size *= 2;
+        }
+        chunk = malloc(sizeof(string_chunk) + size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->size = size;
+        chunk->next = sb->chunk;
+        sb->chunk = chunk;
+        sb->used = 0;
+    }
+
+    char *copy = chunk->data + sb->used;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    sb->used += len + 1;
+
+    return copy;
+
+}
+
+
+// Releases the strings of the previous line. The oldest chunk is kept,
+// since most lines need no more than that
+void reset_strings(parsed_line *pl) {
+
+    string_buffer *sb = pl->str_buf;
+    while (sb->chunk && sb->chunk->next) {
+        string_chunk *next = sb->chunk->next;
+        free(sb->chunk);
+        sb->chunk = next;
+    }
+    sb->used = 0;
+
+}
+
+
+// Copies a NULL terminated list of items and their strings into a single
+// block, for the caller to free. Sets count to the number of items if it
+// is given. Returns NULL if out of memory
+char **copy_items(char **items, size_t *count) {
+
+    size_t n = 0;
+    size_t size = 0;
+    for (; items[n]; ++n) {
+        size += strlen(items[n]) + 1;
+    }
+
+    char **copy = malloc((n + 1) * sizeof(char *) + size);
+    if (copy == NULL) {
+        return NULL;
+    }
+    char *strings = (char *) (copy + n + 1);
+    for (size_t i = 0; i < n; ++i) {
+        size_t len = strlen(items[i]) + 1;
+        copy[i] = memcpy(strings, items[i], len);
+        strings += len;
+    }
+    copy[n] = NULL;
+
+    if (count != NULL) {
+        *count = n;
+    }
+    return copy;
+
+}
+
+
 void free_buffers(parsed_line *pl) {
 
+    reset_strings(pl);
+    free(pl->str_buf->chunk);
+    free(pl->exp_buf->start);
+    free(pl->item_buf->flags);
     free(pl->item_buf->start);
     free(pl->cmd_buf->start);
 
@@ -13,11 +13,30 @@ typedef struct cb {
 // Buffer for all items of all commands of a line
 typedef struct ib {
     char **start;
+    unsigned char *flags; // Word flags of each item, if kept
     size_t size;
 } item_buffer;
 
+// A block of memory that strings are carved from
+typedef struct sc {
+    struct sc *next;
+    size_t size;
+    char data[];
+} string_chunk;
+
+// Buffer for strings made while expanding a line, such as file names.
+// Everything in it is released at once when the next line is expanded
+typedef struct sb {
+    string_chunk *chunk; // Newest first
+    size_t used;         // Bytes used of the newest chunk
+} string_buffer;
+
 int init_buffers(parsed_line *pl);
 int check_buffers(parsed_line  *pl, size_t item_count, size_t pipe_count);
+int reserve_items(item_buffer *buf, size_t count);
+char *store_string(parsed_line *pl, const char *s, size_t len);
+void reset_strings(parsed_line *pl);
+char **copy_items(char **items, size_t *count);
 void free_buffers(parsed_line *pl);
 
 #endif
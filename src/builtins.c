@@ -2,22 +2,60 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <limits.h>
 #include "parser.h"
 #include "builtins.h"
 #include "buffers.h"
+#include "rlimits.h"
+#include "histfile.h"
+#include "vars.h"
+#include "complete.h"
+#include "funcs.h"
+#include "script.h"
+#include "zygote.h"
+#include "linecache.h"
+#include "workdir.h"
+
+
+// The internal commands, looked up by name
+static const struct {
+    const char *name;
+    builtin_fun_ptr fun;
+} builtins[] = {
+    { "cd",       cd },
+    { "exit",     exit_shell },
+    { "help",     help },
+    { "ulimit",   ulimit },
+    { "history",  history },
+    { "export",   export },
+    { "unset",    unset },
+    { "alias",    alias },
+    { "unalias",  unalias },
+    { "return",   return_builtin },
+    { "break",    break_builtin },
+    { "continue", continue_builtin },
+    { "linecache", linecache }
+};
+
+#define BUILTIN_COUNT (sizeof(builtins) / sizeof(builtins[0]))
+
+static int leave_loops_builtin(parsed_line *pl, int next_iteration);
 
 
 // Checks if the first command line item matches an internal command
-void (*try_builtin(parsed_line *pl))(parsed_line *) {
+builtin_fun_ptr try_builtin(parsed_line *pl) {
+
+    return find_builtin(pl->cmd->items[0]);
+
+}
+
+
+// Returns the internal command with the given name, or NULL if none has it
+builtin_fun_ptr find_builtin(const char *name) {
 
-    char *fun = *(pl->cmd->items);
-    if (!strcmp(fun, "cd")) {
-        return cd;
-    } else if (!strcmp(fun, "exit")) {
-        return exit_shell;
-    } else if (!strcmp(fun, "help")) {
-        return help;
+    for (size_t i = 0; i < BUILTIN_COUNT; ++i) {
+        if (!strcmp(name, builtins[i].name)) {
+            return builtins[i].fun;
+        }
     }
 
     return NULL;
@@ -25,66 +63,407 @@ void (*try_builtin(parsed_line *pl))(parsed_line *) {
 }
 
 
-// Changes a process' working directory
-void cd(parsed_line *pl) {
+// Performs the assignments of a line made up of only name=value items,
+// which set shell variables. Returns 0 if the line is something else
+int try_assignments(parsed_line *pl) {
 
-    char *path = *(++pl->cmd->items); // Advance to cd's arg
+    if (pl->pipe_count != 0) {
+        return 0;
+    }
+    for (char **item = pl->cmd->items; *item; ++item) {
+        if (!is_assignment(*item)) {
+            return 0;
+        }
+    }
 
-    char wd[PATH_MAX];
-    getcwd(wd, PATH_MAX);
+    for (char **item = pl->cmd->items; *item; ++item) {
+        int len = is_assignment(*item);
+        if (set_var(*item, len, *item + len + 1, 0) < 0) {
+            fprintf(stderr, "Out of memory\n");
+            break;
+        }
+        var_changed(*item, len);
+    }
+    return 1;
 
-    if (path == NULL) {
-        // Home
-        path = getenv("HOME");
-    } else if (path[0] == '.' && !path[1]) {
-        // Current
-        return;
-    } else if (path[0] == '.' && path[1] == '.' && !path[2]) {
-        // Parent
-        char *last_slash = strrchr(wd, '/');
-        *(last_slash+1) = '\0';
-        // Path is now that of the parent directory
-        path = wd;
-    } else if (*path != '/') {
-        // Relative path: concatenate current directory, /, and argument
-        strncat(wd, "/", 1);
-        strncat(wd, path, strlen(path));
-        path = wd;
+}
+
+
+// Lets the parts of the shell that depend on a variable know it changed
+void var_changed(const char *name, size_t len) {
+
+    if (len == 4 && !strncmp(name, "PATH", 4)) {
+        refresh_exec_index();
+    } else if (len == strlen(ZYGOTE_VAR) && !strncmp(name, ZYGOTE_VAR, len)) {
+        const char *count = get_var(ZYGOTE_VAR);
+        set_zygote_count(count ? strtoul(count, NULL, 10) : 0);
     }
 
-    int status = 0;
+}
+
+
+// Returns the name of the i:th internal command, or NULL past the last one
+const char *builtin_name(size_t i) {
+
+    return i < BUILTIN_COUNT ? builtins[i].name : NULL;
+
+}
 
-    status = chdir(path);
 
-    if (status != 0) {
+// Changes the working directory of the shell, taking a relative path
+// from the one the prompt shows
+int cd(parsed_line *pl) {
+
+    const char *path = pl->cmd->items[1];
+
+    if (path == NULL) {
+        // Home
+        path = get_var("HOME");
+    }
+    if (path == NULL) {
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
+    }
+    if (change_dir(path) < 0) {
         fprintf(stderr, "Unknown path: %s\n", path);
+        return 1;
     }
+    return 0;
 
 }
 
 
 // Exits the shell
-void exit_shell(parsed_line *pl) {
+int exit_shell(parsed_line *pl) {
 
     free_buffers(pl);
     exit(EXIT_SUCCESS);
+    return 0;
+
+}
+
+
+// Sets or prints the resource limits of jobs started by the shell
+int ulimit(parsed_line *pl) {
+
+    char **args = pl->cmd->items + 1;
+
+    if (*args == NULL) {
+        print_limits(shell_limits());
+        return 0;
+    }
+    if (args[1] == NULL && args[0][0] == '-') {
+        return print_limit(shell_limits(), args[0]) < 0;
+    }
+
+    // Parse into a copy so a bad option leaves the limits untouched
+    job_limits limits = *shell_limits();
+    int consumed = parse_limits(args, &limits);
+    if (consumed < 0) {
+        return 1;
+    }
+    if (args[consumed] != NULL) {
+        fprintf(stderr, "ulimit: unexpected %s\n", args[consumed]);
+        return 1;
+    }
+    *shell_limits() = limits;
+    return 0;
+
+}
+
+
+// Lines after the first of an entry are lined up under it
+static void print_entry(size_t num, const char *entry, size_t len) {
+
+    const char *sep;
+    printf("%6zu  ", num);
+    while ((sep = memchr(entry, HIST_NEWLINE, len))) {
+        printf("%.*s\n        ", (int) (sep - entry), entry);
+        len -= sep - entry + 1;
+        entry = sep + 1;
+    }
+    printf("%.*s\n", (int) len, entry);
+
+}
+
+
+// Exports variables, optionally giving them values,
+// or lists the exported variables
+int export(parsed_line *pl) {
+
+    char **args = pl->cmd->items + 1;
+
+    if (*args == NULL) {
+        print_exported();
+        return 0;
+    }
+
+    int status = 0;
+    for (; *args; ++args) {
+        int len = is_assignment(*args);
+        int res;
+        if (len) {
+            res = set_var(*args, len, *args + len + 1, 1);
+        } else if (is_name_start(**args)) {
+            len = strlen(*args);
+            res = export_var(*args);
+        } else {
+            fprintf(stderr, "export: bad name %s\n", *args);
+            status = 1;
+            continue;
+        }
+        if (res < 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        var_changed(*args, len);
+    }
+    return status;
+
+}
+
+
+// Removes variables, or functions if given -f
+int unset(parsed_line *pl) {
+
+    char **args = pl->cmd->items + 1;
+
+    if (*args && !strcmp(*args, "-f")) {
+        for (++args; *args; ++args) {
+            remove_function(*args);
+        }
+        return 0;
+    }
+
+    for (; *args; ++args) {
+        if (unset_var(*args) == 0) {
+            var_changed(*args, strlen(*args));
+        }
+    }
+    return 0;
+
+}
+
+
+// Defines aliases for pipelines, or prints them
+int alias(parsed_line *pl) {
+
+    // Defining an alias lexes it in the parse buffers, and may
+    // replace the alias these very arguments came from
+    char **args = copy_items(pl->cmd->items + 1, NULL);
+    if (args == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int status = 0;
+    if (*args == NULL) {
+        print_aliases();
+    }
+    for (char **arg = args; *arg; ++arg) {
+        char *eq = strchr(*arg, '=');
+        if (eq == NULL) {
+            if (print_alias(*arg) < 0) {
+                fprintf(stderr, "alias: %s not found\n", *arg);
+                status = 1;
+            }
+        } else if (eq == *arg) {
+            fprintf(stderr, "alias: bad name %s\n", *arg);
+            status = 1;
+        } else if (define_alias(*arg, eq - *arg, eq + 1, pl) < 0) {
+            status = 1;
+        }
+    }
+
+    free(args);
+    return status;
+
+}
+
+
+// Removes aliases
+int unalias(parsed_line *pl) {
+
+    char **args = copy_items(pl->cmd->items + 1, NULL);
+    if (args == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int status = 0;
+    for (char **arg = args; *arg; ++arg) {
+        if (remove_alias(*arg) < 0) {
+            fprintf(stderr, "unalias: %s not found\n", *arg);
+            status = 1;
+        }
+    }
+
+    free(args);
+    return status;
+
+}
+
+
+// Leaves the function being run, with the given status or 0
+int return_builtin(parsed_line *pl) {
+
+    char **args = pl->cmd->items + 1;
+    int status = 0;
+
+    if (*args) {
+        char *end;
+        status = strtol(*args, &end, 10);
+        if (*end != '\0') {
+            fprintf(stderr, "return: bad status %s\n", *args);
+            status = 1;
+        }
+    }
+    if (return_from_function(status) < 0) {
+        fprintf(stderr, "return: not in a function\n");
+        return 1;
+    }
+    return status & 255;
+
+}
+
+
+// Leaves the innermost loop, or as many as given
+int break_builtin(parsed_line *pl) {
+
+    return leave_loops_builtin(pl, 0);
+
+}
+
+
+// Goes on with the next iteration of the innermost loop,
+// or of the loop as many levels out as given
+int continue_builtin(parsed_line *pl) {
+
+    return leave_loops_builtin(pl, 1);
+
+}
+
+
+static int leave_loops_builtin(parsed_line *pl, int next_iteration) {
+
+    const char *name = pl->cmd->items[0];
+    char **args = pl->cmd->items + 1;
+    long count = 1;
+
+    if (*args) {
+        char *end;
+        count = strtol(*args, &end, 10);
+        if (*end != '\0' || count < 1) {
+            fprintf(stderr, "%s: bad count %s\n", name, *args);
+            return 1;
+        }
+    }
+    if (leave_loops(count, next_iteration) < 0) {
+        fprintf(stderr, "%s: not in a loop\n", name);
+        return 1;
+    }
+    return 0;
+
+}
+
+
+// Lists the last entries of the history, or those matching a prefix or
+// substring
+int history(parsed_line *pl) {
+
+    char **args = pl->cmd->items + 1;
+    size_t count = 16;
+
+    if (args[0] && (!strcmp(args[0], "-p") || !strcmp(args[0], "-s"))) {
+        if (args[1] == NULL) {
+            fprintf(stderr, "history: %s expects a string\n", args[0]);
+            return 1;
+        }
+        hist_search(args[0][1] == 'p' ? MATCH_PREFIX : MATCH_SUBSTRING,
+                       args[1], print_entry);
+        return 0;
+    }
+
+    if (args[0]) {
+        char *end;
+        count = strtoul(args[0], &end, 10);
+        // strtoul would take -5 as a huge count
+        if (*end != '\0' || end == args[0] || args[0][0] == '-') {
+            fprintf(stderr, "history: bad count %s\n", args[0]);
+            return 1;
+        }
+    }
+
+    hist_tail(count, print_entry);
+    return 0;
+
+}
+
+
+// Shows how often lines were found in the line cache,
+// or empties it if given -c
+int linecache(parsed_line *pl) {
+
+    char **args = pl->cmd->items + 1;
+    if (*args && !strcmp(*args, "-c")) {
+        invalidate_line_cache();
+    } else if (*args) {
+        fprintf(stderr, "linecache: unexpected %s\n", *args);
+        return 1;
+    } else {
+        print_line_cache();
+    }
+    return 0;
 
 }
 
 
 // Prints a help message
-void help() {
+int help() {
 
     char *message = "\n Usage:\n\n   command [ | command ]*\n\n"
                     " where command is an absolute path or"
                     " something that can be found through $PATH.\n\n"
                     " Redirections such as '< infile' and '> outfile'"
                     " may appear after a command.\n"
+                    " '<<word' feeds it the lines that follow, up to one"
+                    " that is word,\n and '<<< word' the word itself.\n"
                     " Appending an '&' to a line"
-                    " will run the job in the background.\n\n"
+                    " will run the job in the background.\n"
+                    " $name and ${name} are replaced by the value of"
+                    " the variable, which 'name=value' sets.\n"
+                    " Text in '...' is taken literally, in \"...\" only $name"
+                    " is expanded,\n and \\ escapes the next character."
+                    " Outside quotes, a value is split\n into words at"
+                    " blanks.\n\n"
+                    " Commands are separated by ';' or newlines, and"
+                    " 'name() { commands; }' defines\n a function, which"
+                    " gets its arguments as $1, $2, ..., $# and $@.\n"
+                    " $? is the status of the last command.\n"
+                    " Setting BUNSH_ZYGOTES=n keeps n processes waiting"
+                    " to start commands.\n"
+                    " 'pipestat command | command...' reports the"
+                    " throughput of each pipe when the job ends.\n\n"
+                    " Compound commands:\n"
+                    "  if commands; then commands; [elif commands; then"
+                    " commands;]... [else commands;] fi\n"
+                    "  while commands; do commands; done\n"
+                    "  until commands; do commands; done\n"
+                    "  for name [in word...]; do commands; done\n"
+                    "  { commands; }       in the shell\n"
+                    "  ( commands )        in a child process\n"
+                    " A group takes < and > for all of its commands, and"
+                    " can be a stage of a pipeline.\n\n"
                     " Commands defined internally:\n"
-                    "  cd [dir]\n  exit\n  help\n\n";
+                    "  cd [dir]\n  exit\n  help\n"
+                    "  export [name[=value]]...\n  unset [-f] name...\n"
+                    "  alias [name[=pipeline]]...\n  unalias name...\n"
+                    "  return [status]\n  break [count]\n"
+                    "  continue [count]\n  linecache [-c]\n"
+                    "  history [count | -p prefix | -s substring]\n"
+                    "  ulimit [-cdfnstuv limit]... [command]\n\n";
 
     printf("%s", message);
+    return 0;
 
 }
@@ -1,11 +1,26 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
-typedef void (*builtin_fun_ptr)(parsed_line *);
+// An internal command returns its status, like a process does
+typedef int (*builtin_fun_ptr)(parsed_line *);
 
-void (*try_builtin(parsed_line *pl))(parsed_line *);
-void exit_shell(parsed_line *pl);
-void cd(parsed_line *pl);
-void help();
+builtin_fun_ptr try_builtin(parsed_line *pl);
+builtin_fun_ptr find_builtin(const char *name);
+const char *builtin_name(size_t i);
+int try_assignments(parsed_line *pl);
+void var_changed(const char *name, size_t len);
+int exit_shell(parsed_line *pl);
+int cd(parsed_line *pl);
+int ulimit(parsed_line *pl);
+int history(parsed_line *pl);
+int export(parsed_line *pl);
+int unset(parsed_line *pl);
+int alias(parsed_line *pl);
+int unalias(parsed_line *pl);
+int return_builtin(parsed_line *pl);
+int break_builtin(parsed_line *pl);
+int continue_builtin(parsed_line *pl);
+int linecache(parsed_line *pl);
+int help();
 
 #endif
@@ -0,0 +1,560 @@
+#define _GNU_SOURCE // pipe2
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <readline/readline.h>
+#include "parser.h"
+#include "builtins.h"
+#include "complete.h"
+#include "vars.h"
+#include "funcs.h"
+
+// The executables found in one directory of $PATH
+typedef struct dl {
+    char *path;
+    int wd;                 // inotify watch descriptor, or -1
+    struct timespec mtime;  // Modification time when last scanned
+    char *names;            // Null separated names
+    size_t names_len;
+    size_t names_size;
+    size_t count;
+    int dirty;
+} dir_listing;
+
+// Everything that can be run by name, sorted so that all names with
+// a given prefix are next to each other
+typedef struct ei {
+    const char **names;
+    size_t count;
+    char *blob; // Where the names of executables are stored
+} exec_index;
+
+// The index is built and kept up to date by a background thread.
+// Completion only ever reads the latest published index, under the lock.
+// A new $PATH is handed over under the lock as well, and the thread is
+// woken up through a pipe to rebuild from it.
+static struct {
+    pthread_mutex_t lock;
+    exec_index *current;
+    char *new_path;
+    int wake[2];
+    dir_listing *dirs;
+    size_t dir_count;
+    int inotify_fd;
+} idx = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, { -1, -1 }, NULL, 0, -1 };
+
+static void *index_thread(void *path);
+static int add_dirs(char *path);
+static int watch_dir(dir_listing *dir);
+static void remove_dirs();
+static void scan_dir(dir_listing *dir);
+static int dir_changed(dir_listing *dir);
+static void handle_events();
+static void publish();
+static int name_cmp(const void *a, const void *b);
+static char *exec_generator(const char *text, int state);
+static void add_match(const char *name, void *text);
+
+// Words after which the next word is a command name, if they are one
+static const char *const command_words[] = {
+    "{", "if", "then", "elif", "else", "while", "until", "do", NULL
+};
+
+// Names handed out by exec_generator
+static struct {
+    char **names;
+    size_t count;
+    size_t cap;
+    size_t next;
+} matches;
+
+
+// Starts building the index of executables in the background
+int start_exec_index() {
+
+    const char *var = get_var("PATH");
+    char *path;
+    if (var == NULL || (path = strdup(var)) == NULL) {
+        return -1;
+    }
+    if (pipe2(idx.wake, O_CLOEXEC|O_NONBLOCK) < 0) {
+        free(path);
+        return -1;
+    }
+
+    // Signals are for the main thread to handle
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    pthread_t thread;
+    int res = pthread_create(&thread, NULL, index_thread, path);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (res != 0) {
+        free(path);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+
+}
+
+
+// Rebuilds the index from the current value of $PATH
+void refresh_exec_index() {
+
+    if (idx.wake[1] < 0) {
+        return;
+    }
+
+    const char *var = get_var("PATH");
+    char *path = strdup(var ? var : "");
+    if (path == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&idx.lock);
+    free(idx.new_path);
+    idx.new_path = path;
+    pthread_mutex_unlock(&idx.lock);
+
+    write(idx.wake[1], "", 1);
+
+}
+
+
+// Readline completion hook. Names of commands are completed from the index
+// and the functions and aliases defined, anything else is left to
+// readline's own filename completion
+char **complete_command(const char *text, int start, int end) {
+
+    if (!command_position(rl_line_buffer, start)) {
+        return NULL;
+    }
+
+    // Paths are completed as files
+    if (strchr(text, '/')) {
+        return NULL;
+    }
+
+    return rl_completion_matches(text, exec_generator);
+
+}
+
+
+// Checks if the word starting at start in line is the first word of a
+// command, where a command name goes: at the start of the line, after |, &,
+// ;, ( or a newline, or after a word such as then or do that is itself the
+// first word of a command
+int command_position(const char *line, int start) {
+
+    int pos = start;
+    while (pos > 0 && (line[pos - 1] == ' ' || line[pos - 1] == '\t')) {
+        pos--;
+    }
+    if (pos == 0 || strchr("|&;(\n", line[pos - 1])) {
+        return 1;
+    }
+
+    int word_end = pos;
+    while (pos > 0 && !strchr(" \t\n|&;()", line[pos - 1])) {
+        pos--;
+    }
+    for (const char *const *w = command_words; *w; ++w) {
+        size_t len = strlen(*w);
+        if (word_end - pos == (int) len && !strncmp(line + pos, *w, len)) {
+            return command_position(line, pos);
+        }
+    }
+    return 0;
+
+}
+
+
+// Hands readline the names in the index, and the functions and aliases,
+// starting with text, one per call. They are copied out on the first call,
+// so the index is not kept locked while readline goes on asking for them
+static char *exec_generator(const char *text, int state) {
+
+    if (state == 0) {
+        // Whatever readline did not ask for last time
+        while (matches.next < matches.count) {
+            free(matches.names[matches.next++]);
+        }
+        matches.count = matches.next = 0;
+
+        pthread_mutex_lock(&idx.lock);
+        exec_index *ei = idx.current;
+        size_t len = strlen(text);
+        size_t lo = 0;
+        size_t hi = ei ? ei->count : 0;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (strcmp(ei->names[mid], text) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        while (ei && lo < ei->count && !strncmp(ei->names[lo], text, len)) {
+            add_match(ei->names[lo++], (void *) text);
+        }
+        pthread_mutex_unlock(&idx.lock);
+
+        // Readline leaves out names given twice
+        visit_definitions(add_match, (void *) text);
+    }
+
+    // Readline frees the names it is given
+    return matches.next < matches.count ? matches.names[matches.next++] :
+                                          NULL;
+
+}
+
+
+// Keeps a copy of name for exec_generator to hand out if it starts with text
+static void add_match(const char *name, void *text) {
+
+    if (strncmp(name, text, strlen(text))) {
+        return;
+    }
+    if (matches.count == matches.cap) {
+        size_t cap = matches.cap ? 2 * matches.cap : 64;
+        char **grown = realloc(matches.names, cap * sizeof(char *));
+        if (grown == NULL) {
+            return;
+        }
+        matches.names = grown;
+        matches.cap = cap;
+    }
+    if ((matches.names[matches.count] = strdup(name)) != NULL) {
+        matches.count++;
+    }
+
+}
+
+
+// Scans $PATH, publishes the index, and then rescans the directories that
+// inotify reports changes in. Directories are also checked periodically,
+// since changes made by other hosts to network mounts are not reported
+static void *index_thread(void *path) {
+
+    idx.inotify_fd = inotify_init1(IN_CLOEXEC);
+
+    if (add_dirs(path) < 0) {
+        free(path);
+        return NULL;
+    }
+    free(path);
+
+    for (size_t i = 0; i < idx.dir_count; ++i) {
+        scan_dir(&idx.dirs[i]);
+    }
+    publish();
+
+    // Negative descriptors are ignored by poll
+    struct pollfd pfd[2] = {
+        { idx.inotify_fd, POLLIN, 0 },
+        { idx.wake[0], POLLIN, 0 }
+    };
+
+    for (;;) {
+        int res = poll(pfd, 2, RESCAN_INTERVAL);
+        if (res < 0) {
+            continue;
+        }
+
+        if (pfd[1].revents) {
+            char drain[64];
+            while (read(idx.wake[0], drain, sizeof(drain)) > 0) {
+                ;
+            }
+            pthread_mutex_lock(&idx.lock);
+            path = idx.new_path;
+            idx.new_path = NULL;
+            pthread_mutex_unlock(&idx.lock);
+
+            if (path) {
+                remove_dirs();
+                add_dirs(path);
+                free(path);
+                for (size_t i = 0; i < idx.dir_count; ++i) {
+                    idx.dirs[i].dirty = 1;
+                }
+            }
+        } else if (res > 0) {
+            // Let the rest of e.g. a package installation arrive first
+            do {
+                handle_events();
+            } while (poll(pfd, 1, SETTLE_TIME) > 0);
+        } else {
+            for (size_t i = 0; i < idx.dir_count; ++i) {
+                idx.dirs[i].dirty |= dir_changed(&idx.dirs[i]);
+            }
+        }
+
+        // A directory that went away is watched again once it is back
+        for (size_t i = 0; i < idx.dir_count; ++i) {
+            if (idx.dirs[i].wd < 0 && watch_dir(&idx.dirs[i])) {
+                idx.dirs[i].dirty = 1;
+            }
+        }
+
+        int changed = 0;
+        for (size_t i = 0; i < idx.dir_count; ++i) {
+            if (idx.dirs[i].dirty) {
+                scan_dir(&idx.dirs[i]);
+                changed = 1;
+            }
+        }
+        if (changed) {
+            publish();
+        }
+    }
+
+    return NULL;
+
+}
+
+
+// Sets up a listing, and a watch if possible, for each absolute
+// directory in a colon separated path
+static int add_dirs(char *path) {
+
+    size_t max_dirs = 1;
+    for (char *c = path; *c; ++c) {
+        max_dirs += *c == ':';
+    }
+    idx.dirs = calloc(max_dirs, sizeof(dir_listing));
+    if (idx.dirs == NULL) {
+        return -1;
+    }
+
+    char *save;
+    for (char *dir = strtok_r(path, ":", &save); dir;
+         dir = strtok_r(NULL, ":", &save)) {
+        // Relative entries depend on the working directory, so are not cached
+        if (*dir != '/') {
+            continue;
+        }
+        dir_listing *d = &idx.dirs[idx.dir_count++];
+        d->path = strdup(dir);
+        d->wd = -1;
+        watch_dir(d);
+    }
+
+    return 0;
+
+}
+
+
+// Starts watching a directory, if there is one at its path.
+// Returns whether it is watched now
+static int watch_dir(dir_listing *dir) {
+
+    if (idx.inotify_fd >= 0 && dir->path != NULL) {
+        dir->wd = inotify_add_watch(idx.inotify_fd, dir->path,
+                                    IN_CREATE|IN_DELETE|IN_ATTRIB|
+                                    IN_MOVED_FROM|IN_MOVED_TO|
+                                    IN_DELETE_SELF|IN_MOVE_SELF|
+                                    IN_ONLYDIR);
+    }
+    return dir->wd >= 0;
+
+}
+
+
+// Stops watching and forgets the directories of the old $PATH
+static void remove_dirs() {
+
+    for (size_t i = 0; i < idx.dir_count; ++i) {
+        if (idx.dirs[i].wd >= 0) {
+            inotify_rm_watch(idx.inotify_fd, idx.dirs[i].wd);
+        }
+        free(idx.dirs[i].path);
+        free(idx.dirs[i].names);
+    }
+    free(idx.dirs);
+    idx.dirs = NULL;
+    idx.dir_count = 0;
+
+}
+
+
+// Reads the names of the executable files in a directory
+static void scan_dir(dir_listing *dir) {
+
+    dir->names_len = 0;
+    dir->count = 0;
+    dir->dirty = 0;
+
+    if (dir->path == NULL) {
+        return;
+    }
+    int fd = open(dir->path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        dir->mtime = st.st_mtim;
+    }
+    DIR *d = fdopendir(fd);
+    if (d == NULL) {
+        close(fd);
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.' || ent->d_type == DT_DIR) {
+            continue;
+        }
+        if (fstatat(fd, ent->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode) ||
+            !(st.st_mode & (S_IXUSR|S_IXGRP|S_IXOTH))) {
+            continue;
+        }
+
+        size_t len = strlen(ent->d_name) + 1;
+        if (dir->names_len + len > dir->names_size) {
+            size_t size = dir->names_size ? 2 * dir->names_size : 4096;
+            while (size < dir->names_len + len) {
+                size *= 2;
+            }
+            char *grown = realloc(dir->names, size);
+            if (grown == NULL) {
+                break;
+            }
+            dir->names = grown;
+            dir->names_size = size;
+        }
+        memcpy(dir->names + dir->names_len, ent->d_name, len);
+        dir->names_len += len;
+        dir->count++;
+    }
+
+    closedir(d);
+
+}
+
+
+// Checks if a directory has been modified since it was scanned
+static int dir_changed(dir_listing *dir) {
+
+    struct stat st;
+    if (dir->path == NULL || stat(dir->path, &st) < 0) {
+        return dir->count > 0;
+    }
+    return st.st_mtim.tv_sec != dir->mtime.tv_sec ||
+           st.st_mtim.tv_nsec != dir->mtime.tv_nsec;
+
+}
+
+
+// Marks the directories that inotify reports changes in
+static void handle_events() {
+
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(idx.inotify_fd, buf, sizeof(buf));
+
+    for (char *p = buf; len > 0 && p < buf + len; ) {
+        struct inotify_event *ev = (struct inotify_event *) p;
+        for (size_t i = 0; i < idx.dir_count; ++i) {
+            // Events were lost, so everything might have changed
+            if (ev->mask & IN_Q_OVERFLOW || idx.dirs[i].wd == ev->wd) {
+                idx.dirs[i].dirty = 1;
+            }
+            // The directory is gone, and its watch with it
+            if (idx.dirs[i].wd == ev->wd &&
+                ev->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED)) {
+                if (ev->mask & IN_MOVE_SELF) {
+                    inotify_rm_watch(idx.inotify_fd, ev->wd);
+                }
+                idx.dirs[i].wd = -1;
+            }
+        }
+        p += sizeof(struct inotify_event) + ev->len;
+    }
+
+}
+
+
+// Merges the directory listings and the builtins into a new index
+// and replaces the current one with it
+static void publish() {
+
+    size_t count = 0;
+    size_t blob_len = 0;
+    for (size_t i = 0; i < idx.dir_count; ++i) {
+        count += idx.dirs[i].count;
+        blob_len += idx.dirs[i].names_len;
+    }
+    size_t builtin_count = 0;
+    while (builtin_name(builtin_count)) {
+        builtin_count++;
+    }
+
+    exec_index *ei = malloc(sizeof(exec_index));
+    if (ei == NULL) {
+        return;
+    }
+    ei->names = malloc((count + builtin_count) * sizeof(char *));
+    ei->blob = malloc(blob_len ? blob_len : 1);
+    if (ei->names == NULL || ei->blob == NULL) {
+        free(ei->names);
+        free(ei->blob);
+        free(ei);
+        return;
+    }
+
+    size_t n = 0;
+    char *pos = ei->blob;
+    for (size_t i = 0; i < idx.dir_count; ++i) {
+        memcpy(pos, idx.dirs[i].names, idx.dirs[i].names_len);
+        for (size_t j = 0; j < idx.dirs[i].count; ++j) {
+            ei->names[n++] = pos;
+            pos += strlen(pos) + 1;
+        }
+    }
+    for (size_t i = 0; i < builtin_count; ++i) {
+        ei->names[n++] = builtin_name(i);
+    }
+
+    // The same name may be in several directories
+    qsort(ei->names, n, sizeof(char *), name_cmp);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (unique == 0 || strcmp(ei->names[unique - 1], ei->names[i])) {
+            ei->names[unique++] = ei->names[i];
+        }
+    }
+    ei->count = unique;
+
+    pthread_mutex_lock(&idx.lock);
+    exec_index *old = idx.current;
+    idx.current = ei;
+    pthread_mutex_unlock(&idx.lock);
+
+    if (old) {
+        free(old->names);
+        free(old->blob);
+        free(old);
+    }
+
+}
+
+
+static int name_cmp(const void *a, const void *b) {
+
+    return strcmp(*(const char **) a, *(const char **) b);
+
+}
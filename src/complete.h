@@ -0,0 +1,13 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#define RESCAN_INTERVAL 60000 // ms between checks of the directories in
+                              // $PATH, for mounts inotify cannot watch
+#define SETTLE_TIME        50 // ms to let a burst of changes finish
+
+int start_exec_index();
+void refresh_exec_index();
+char **complete_command(const char *text, int start, int end);
+int command_position(const char *line, int start);
+
+#endif
@@ -0,0 +1,539 @@
+#define _GNU_SOURCE // pipe2, O_PATH and memfd_create
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "parser.h"
+#include "builtins.h"
+#include "buffers.h"
+#include "rlimits.h"
+#include "vars.h"
+#include "funcs.h"
+#include "script.h"
+#include "zygote.h"
+#include "pipestat.h"
+#include "exec.h"
+
+extern char **environ;
+
+static int run_background(parsed_line *pl, const job_limits *limits,
+                          int metered);
+static int run_pipeline(parsed_line *pl, const job_limits *limits,
+                        int metered);
+static int open_pipes(int p[2], pipe_meter *meter, int *next_in);
+static pid_t start_stage(parsed_line *pl, char **items, int in, int out,
+                         const int *held, size_t held_count, int cwd,
+                         const job_limits *limits);
+static void replace_process(parsed_line *pl, const job_limits *limits);
+void execute_command(parsed_line *pl, char **items);
+static int here_fd(const char *text, size_t len, int newline);
+
+static int in_place; // The next line may take over the process
+
+
+// Runs the commands of a parsed and expanded line.
+// Returns the exit status of the last command of the pipeline
+int interpret_command_line(parsed_line *pl) {
+
+    int replace = in_place;
+    in_place = 0;
+
+    // Nothing is left of a line whose words all expanded to nothing
+    if (pl->cmd->items[0] == NULL) {
+        return 0;
+    }
+
+    // A leading "pipestat" reports on the pipes of this job
+    int metered = strip_pipestat(pl->cmd_buf->start);
+
+    // A leading "ulimit -x value" sets limits for this job only
+    job_limits limits = *shell_limits();
+    int limited = strip_inline_limits(pl->cmd_buf->start, &limits);
+    if (limited < 0) {
+        return 1;
+    }
+
+    // Built-in commands relate to the shell process,
+    // so just execute and return to loop
+    if (try_assignments(pl)) {
+        return 0;
+    }
+    // Functions come first, so they can wrap the built-in commands.
+    // In a pipeline or in the background, either runs in a child
+    node *body = NULL;
+    builtin_fun_ptr f = NULL;
+    if (pl->pipe_count == 0 && !pl->background) {
+        body = find_function(pl->cmd->items[0]);
+        if (body == NULL) {
+            f = try_builtin(pl);
+        }
+    }
+    if (metered && (body || f || pl->pipe_count == 0)) {
+        fprintf(stderr, "pipestat: %s %s, so no pipes are measured\n",
+                pl->cmd->items[0], body || f ? "runs in the shell" :
+                "is not a pipeline");
+        metered = 0;
+    }
+    if (body || f) {
+        int saved[2];
+        int status = 0;
+        // Limits are set for the processes of a job, and this has none
+        if (limited) {
+            fprintf(stderr, "ulimit: %s runs in the shell and cannot be "
+                    "limited\n", pl->cmd->items[0]);
+            return 1;
+        }
+        if (redirect_shell(pl->rstdin, pl->rstdin_kind, pl->rstdout,
+                           saved) < 0) {
+            return 1;
+        }
+        if (body) {
+            status = call_function(body, pl->cmd->items + 1, pl);
+        } else {
+            status = (*f)(pl);
+        }
+        restore_shell(saved);
+        return status;
+    }
+
+    // Otherwise, run the commands in processes of their own,
+    // unless the process running the line has nothing left to do after it
+    if (replace && pl->pipe_count == 0 && !pl->background && !metered) {
+        replace_process(pl, &limits);
+    }
+    if (pl->background) {
+        return run_background(pl, &limits, metered);
+    }
+    return run_pipeline(pl, &limits, metered);
+
+}
+
+
+// Background jobs are run by a process of their own. It is forked twice,
+// so it is inherited by init, which then waits for it
+static int run_background(parsed_line *pl, const job_limits *limits,
+                          int metered) {
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        fprintf(stderr, "Fork error\n");
+        return 1;
+    } else if (pid == 0) {
+        if (fork() != 0) {
+            exit(0);
+        }
+        setpgid(0, 0); // Makes it not receive SIGINT from Ctrl-C
+        if (pl->pipe_count == 0 && !metered) {
+            replace_process(pl, limits);
+        }
+        exit(run_pipeline(pl, limits, metered));
+    }
+    waitpid(pid, NULL, 0);
+    return 0;
+
+}
+
+
+// Starts every command of a pipeline, first to last, each with its stdout
+// connected to the stdin of the next by a pipe, and then waits for all of
+// them. If metered, the shell relays the data between the stages itself
+// and reports on it when they are done. Returns the exit status of the last
+static int run_pipeline(parsed_line *pl, const job_limits *limits,
+                        int metered) {
+
+    size_t count = pl->pipe_count + 1;
+    command *first = pl->cmd_buf->start;
+    pid_t pids[count];
+    size_t started = 0;
+
+    // The shell keeps the ends of the pipes it relays, and the read end of
+    // the pipe the stage being started writes to. No stage should hold them
+    int held[2 * count];
+    size_t held_count = 0;
+    pipe_meter *meters = NULL;
+    size_t meter_count = 0;
+    if (metered && count > 1) {
+        meters = calloc(count - 1, sizeof(pipe_meter));
+        if (meters == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    int in = 0;
+    int last_out = 1;
+    if (pl->rstdin &&
+        (in = open_input(pl->rstdin, pl->rstdin_kind)) == -1) {
+        return 1;
+    }
+    if (pl->rstdout) {
+        last_out = open_output(pl->rstdout);
+        if (last_out == -1) {
+            if (in != 0) {
+                close(in);
+            }
+            return 1;
+        }
+    }
+
+    // Zygotes are told which directory to run in
+    int cwd = -1;
+    if (zygotes_waiting()) {
+        cwd = open(".", O_PATH|O_DIRECTORY|O_CLOEXEC);
+    }
+    // Forked children would write out what is left in the buffer again
+    fflush(stdout);
+
+    for (size_t i = 0; i < count; ++i) {
+        int p[2] = { -1, -1 };
+        int out = last_out;
+        int next_in = -1;
+        if (i + 1 < count) {
+            pipe_meter *meter = meters ? &meters[meter_count] : NULL;
+            if (open_pipes(p, meter, &next_in) < 0) {
+                fprintf(stderr, "Pipe error\n");
+                break;
+            }
+            out = p[1];
+            if (meter) {
+                held[held_count++] = meter->out;
+                meter_count++;
+            }
+            held[held_count++] = p[0];
+        }
+
+        pid_t pid = start_stage(pl, first[i].items, in, out, held,
+                                held_count, cwd, limits);
+        if (in != 0) {
+            close(in);
+        }
+        if (out != 1) {
+            close(out);
+        }
+        in = next_in;
+        if (!meters && held_count > 0) {
+            held_count--;
+        }
+        if (pid == -1) {
+            fprintf(stderr, "Fork error\n");
+            break;
+        }
+        pids[started++] = pid;
+    }
+    if (in > 0) {
+        close(in);
+    }
+    if (cwd != -1) {
+        close(cwd);
+    }
+
+    if (meters) {
+        // A stage that goes away is noticed as an error rather than a signal
+        void (*old)(int) = signal(SIGPIPE, SIG_IGN);
+        relay_pipes(meters, meter_count);
+        signal(SIGPIPE, old);
+    }
+
+    int status = 1;
+    for (size_t i = 0; i < started; ++i) {
+        int res;
+        waitpid(pids[i], &res, 0);
+        if (i == count - 1) {
+            status = WIFSIGNALED(res) ? 128 + WTERMSIG(res) :
+                                        WEXITSTATUS(res);
+        }
+    }
+
+    // Zygotes that were used are replaced in the background once the job
+    // is done, so starting them does not take a processor from it
+    refill_zygotes();
+
+    if (meters) {
+        print_pipestat(meters, meter_count, first);
+        free(meters);
+    }
+    return status;
+
+}
+
+
+// Makes the pipe a stage writes its output to, and sets next_in to where
+// the next stage reads it from. For a metered job that is another pipe,
+// and the shell keeps the ends in between in the meter
+static int open_pipes(int p[2], pipe_meter *meter, int *next_in) {
+
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    if (meter == NULL) {
+        *next_in = p[0];
+        return 0;
+    }
+
+    int q[2];
+    if (pipe2(q, O_CLOEXEC) < 0) {
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+    meter->in = p[0];
+    meter->out = q[1];
+    *next_in = q[0];
+    return 0;
+
+}
+
+
+// Starts a command of a pipeline with in and out as its stdin and stdout.
+// An external command is handed to a zygote if one is waiting, and
+// otherwise the shell forks. The child closes the pipe ends the shell holds, such
+// as the read end of its own output pipe, which is for the next command.
+// Returns the pid of the command, or -1 if it could not be started
+static pid_t start_stage(parsed_line *pl, char **items, int in, int out,
+                         const int *held, size_t held_count, int cwd,
+                         const job_limits *limits) {
+
+    if (cwd != -1 && items[0] && !find_function(items[0]) &&
+        !find_builtin(items[0])) {
+        int fds[ZYGOTE_FDS] = { in, out, 2, cwd };
+        pid_t pid = zygote_exec(items, fds, limits);
+        if (pid != -1) {
+            return pid;
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    // Child
+    signal(SIGINT, SIG_DFL); // A function run here is interrupted too
+    for (size_t i = 0; i < held_count; ++i) {
+        close(held[i]);
+    }
+    if (in != 0) {
+        dup2(in, 0);
+        close(in);
+    }
+    if (out != 1) {
+        dup2(out, 1);
+        close(out);
+    }
+    if (apply_limits(limits) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    execute_command(pl, items);
+    return -1;
+
+}
+
+
+// Makes the next line interpret_command_line runs exec its command in the
+// calling process instead of forking for it, if it is a single command.
+// For the last command of a forked subshell or pipeline stage, where the
+// process would only wait for the command and exit
+void exec_in_place() {
+
+    in_place = 1;
+
+}
+
+
+// Opens what stdin is redirected from. Returns -1 if that cannot be done
+int open_input(const char *target, enum input_kind kind) {
+
+    int fd;
+    if (kind == INPUT_FILE) {
+        fd = open(target, O_RDONLY|O_CLOEXEC);
+    } else {
+        fd = here_fd(target, strlen(target), kind == INPUT_HERESTRING);
+    }
+    if (fd == -1 && kind == INPUT_FILE) {
+        fprintf(stderr, "Unable to open file %s\n", target);
+    } else if (fd == -1) {
+        fprintf(stderr, "Unable to set up here-document\n");
+    }
+    return fd;
+
+}
+
+
+// Opens a file stdout is redirected to. Returns -1 if that cannot be done
+int open_output(const char *target) {
+
+    int fd = open(target, O_CREAT|O_WRONLY|O_CLOEXEC, S_IRUSR|S_IWUSR);
+    if (fd == -1) {
+        fprintf(stderr, "Unable to open file %s\n", target);
+    }
+    return fd;
+
+}
+
+
+// Returns a descriptor to read the text of a here-document or here-string
+// from, with a newline added if asked to. The text is written to a pipe if
+// the pipe takes all of it at once, and otherwise to a file in memory.
+// Either way, nothing touches the file system
+static int here_fd(const char *text, size_t len, int newline) {
+
+    struct iovec iov[2] = {
+        { (void *) text, len },
+        { "\n", newline }
+    };
+    size_t total = len + newline;
+
+    int p[2];
+    if (total <= HERE_PIPE_MAX && pipe2(p, O_CLOEXEC) == 0) {
+        // A full pipe fails the write rather than wait for a reader
+        fcntl(p[1], F_SETFL, O_NONBLOCK);
+        ssize_t n = writev(p[1], iov, 2);
+        close(p[1]);
+        if (n == (ssize_t) total) {
+            return p[0];
+        }
+        close(p[0]);
+    }
+
+    int fd = memfd_create("here-document", MFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t written = 0;
+    while (written < total) {
+        ssize_t n = written < len ? write(fd, text + written, len - written) :
+                                    write(fd, "\n", 1);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+
+}
+
+
+// Points stdin and stdout to the redirection targets of commands run in
+// the shell itself, keeping the old ones in saved unless it is NULL, as in
+// a child that will not need them. Either target may be NULL.
+// Returns -1 if one cannot be opened
+int redirect_shell(const char *in, enum input_kind kind, const char *out,
+                   int saved[2]) {
+
+    if (saved) {
+        saved[0] = saved[1] = -1;
+    }
+
+    if (in) {
+        int fd = open_input(in, kind);
+        if (fd == -1) {
+            return -1;
+        }
+        if (saved) {
+            saved[0] = dup(0);
+        }
+        dup2(fd, 0);
+        close(fd);
+    }
+    if (out) {
+        int fd = open_output(out);
+        if (fd == -1) {
+            if (saved) {
+                restore_shell(saved);
+            }
+            return -1;
+        }
+        fflush(stdout);
+        if (saved) {
+            saved[1] = dup(1);
+        }
+        dup2(fd, 1);
+        close(fd);
+    }
+    return 0;
+
+}
+
+
+void restore_shell(int saved[2]) {
+
+    for (int fd = 0; fd < 2; ++fd) {
+        if (saved[fd] != -1) {
+            if (fd == 1) {
+                fflush(stdout);
+            }
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        }
+    }
+
+}
+
+
+// Runs a single command in the calling process, which an external command
+// replaces. Does not return
+static void replace_process(parsed_line *pl, const job_limits *limits) {
+
+    if (redirect_shell(pl->rstdin, pl->rstdin_kind, pl->rstdout,
+                       NULL) < 0 || apply_limits(limits) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+    execute_command(pl, pl->cmd->items);
+
+}
+
+
+// Executes a single command in the calling process
+void execute_command(parsed_line *pl, char **items) {
+
+    // A stage whose words all expanded to nothing
+    if (items[0] == NULL) {
+        exit(0);
+    }
+
+    // A function in a pipeline or in the background
+    // runs in the process made for it
+    node *body = find_function(items[0]);
+    if (body) {
+        exit(call_function(body, items + 1, pl));
+    }
+
+    size_t argc = 0;
+    while (*items != NULL) {
+        argc++;
+        items++;
+    }
+    items -= argc;
+
+    // So is a built-in command, which reads its arguments from pl->cmd
+    builtin_fun_ptr f = find_builtin(items[0]);
+    if (f) {
+        command stage = { items, argc, 0, NULL };
+        pl->cmd = &stage;
+        exit((*f)(pl));
+    }
+
+    char *argv[argc+1];
+    argv[argc] = NULL;
+    for (size_t i = 0; i < argc; ++i, ++items) {
+        argv[i] = *items;
+    }
+
+    environ = get_envp(); // The shell's exported variables
+    execvp(argv[0], argv);
+
+    // execvp failed
+    fprintf(stderr, "Unknown or malformatted command: %s\n", argv[0]);
+    exit(EXIT_FAILURE);
+
+}
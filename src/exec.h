@@ -0,0 +1,17 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#define HERE_PIPE_MAX (1 << 16) // Larger here-documents go to a memory file
+
+typedef struct pl parsed_line;
+enum input_kind;
+
+int interpret_command_line(parsed_line *pl);
+void exec_in_place();
+int open_input(const char *target, enum input_kind kind);
+int open_output(const char *target);
+int redirect_shell(const char *in, enum input_kind kind, const char *out,
+                   int saved[2]);
+void restore_shell(int saved[2]);
+
+#endif
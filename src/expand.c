@@ -0,0 +1,524 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "parser.h"
+#include "buffers.h"
+#include "expand.h"
+#include "wildcard.h"
+#include "vars.h"
+
+#define SHELL_NAME "bunsh" // What $0 gives
+
+// Where the items of the expanded line are being written
+typedef struct ex {
+    parsed_line *pl;
+    size_t count;
+} expansion;
+
+// Where a field of a word ends, in the word and in its pattern
+typedef struct fe {
+    size_t word_end;
+    size_t pattern_end;
+    int wild;    // Has unquoted wildcards
+} field_end;
+
+// A word being expanded. Besides the word itself, a wildcard pattern is
+// built where the quoted characters are escaped, so they match literally.
+// Blanks in unquoted values split the word into fields, each of which
+// becomes items of its own
+typedef struct wb {
+    char *word;
+    size_t word_len;
+    size_t word_size;
+    char *pattern;
+    size_t pattern_len;
+    size_t pattern_size;
+    int quoted;  // Had quotes, so stays even if empty
+    int wild;    // Has unquoted wildcards
+    int split;   // Values are split into fields
+    int started; // The field being built has characters or quotes
+    field_end *fields; // Ends of the fields before the last
+    size_t field_count;
+    size_t field_size;
+} word_builder;
+
+#define is_blank(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+static int expand_word(expansion *ex, const char *raw);
+static int push_field(expansion *ex, word_builder *wb, const field_end *from,
+                      const field_end *to, int started);
+static int build_word(word_builder *wb, const char *raw, int split);
+static int end_field(word_builder *wb);
+static const char *param_ref(const char *c, const char **name, size_t *len);
+static int put_param(word_builder *wb, const char *name, size_t len,
+                     int quoted);
+static int put_value(word_builder *wb, const char *value, int quoted);
+static int put_char(word_builder *wb, char c, int quoted);
+static int put_string(char **buf, size_t *len, size_t *size,
+                      const char *s, size_t n);
+static int push_item(expansion *ex, char *item);
+static int push_path(void *ctx, const char *path, size_t len);
+static int item_cmp(const void *a, const void *b);
+
+
+// Replaces the items of each command of a parsed line with what they
+// expand to. Only items the lexer flagged are looked at. Quotes are
+// removed and variables substituted, and a word that becomes empty without
+// having been quoted is dropped. An unquoted value is split into separate
+// words at spaces, tabs and newlines. Words with unquoted wildcards then become
+// the sorted list of paths matching them, or stay as they are if nothing
+// matches. The expanded items are written to the expansion buffer, and the
+// commands are pointed there. Redirection targets are expanded too, but
+// never to more than one word
+int expand_line(parsed_line *pl) {
+
+    // Strings and directory listings of the previous line are done with
+    reset_strings(pl);
+    clear_dir_cache();
+
+    if (pl->rstdin_flags & WORD_DYNAMIC) {
+        pl->rstdin = pl->rstdin_kind == INPUT_HEREDOC ?
+                     expand_text(pl, pl->rstdin) :
+                     expand_single(pl, pl->rstdin);
+    }
+    if (pl->rstdout_flags & WORD_DYNAMIC) {
+        pl->rstdout = expand_single(pl, pl->rstdout);
+    }
+    if ((pl->rstdin_flags && !pl->rstdin) ||
+        (pl->rstdout_flags && !pl->rstdout)) {
+        return -1;
+    }
+
+    command *first = pl->cmd_buf->start;
+    size_t cmd_count = pl->pipe_count + 1;
+    char **items = pl->item_buf->start;
+    unsigned char *flags = pl->item_buf->flags;
+
+    // Most lines have nothing to expand, so leave them where they are
+    int found = 0;
+    for (size_t i = 0; i < cmd_count && !found; ++i) {
+        size_t pos = first[i].items - items;
+        for (size_t j = 0; j < first[i].length && !found; ++j) {
+            found = flags[pos + j] & WORD_DYNAMIC;
+        }
+    }
+    if (!found) {
+        return 0;
+    }
+
+    expansion ex = { pl, 0 };
+
+    for (size_t i = 0; i < cmd_count; ++i) {
+        size_t cmd_start = ex.count;
+        size_t pos = first[i].items - items;
+        for (size_t j = 0; j < first[i].length; ++j) {
+            int res = flags[pos + j] & WORD_DYNAMIC ?
+                      expand_word(&ex, items[pos + j]) :
+                      push_item(&ex, items[pos + j]);
+            if (res < 0) {
+                return -1;
+            }
+        }
+        first[i].length = ex.count - cmd_start;
+        if (push_item(&ex, NULL) < 0) {
+            return -1;
+        }
+    }
+
+    // The buffer has settled, so the commands can point into it
+    char **exp_items = pl->exp_buf->start;
+    for (size_t i = 0; i < cmd_count; ++i) {
+        first[i].items = exp_items;
+        exp_items += first[i].length + 1;
+    }
+
+    return 0;
+
+}
+
+
+// Removes the quotes of a word as written and substitutes its variables,
+// but does not match wildcards. Returns the result, kept in the string
+// buffer, or NULL if out of memory
+char *expand_single(parsed_line *pl, const char *raw) {
+
+    static word_builder wb;
+    if (build_word(&wb, raw, 0) < 0) {
+        return NULL;
+    }
+    return store_string(pl, wb.word, wb.word_len);
+
+}
+
+
+// Substitutes the variables in the text of a here-document. Quotes mean
+// nothing there, and a backslash only escapes $, `, \ and newlines.
+// Returns the result, kept in the string buffer, or NULL if out of memory
+char *expand_text(parsed_line *pl, const char *raw) {
+
+    static word_builder wb;
+    wb.word_len = 0;
+    wb.pattern_len = 0;
+
+    const char *c = raw;
+    while (*c != '\0') {
+        const char *name;
+        size_t len;
+        const char *next = param_ref(c, &name, &len);
+        int res;
+        if (next != NULL) {
+            res = put_param(&wb, name, len, 1);
+            c = next;
+        } else if (*c == ESCAPE && c[1] == '\n') {
+            res = 0;
+            c += 2;
+        } else {
+            if (*c == ESCAPE && (c[1] == '$' || c[1] == '`' ||
+                                 c[1] == ESCAPE)) {
+                c++;
+            }
+            res = put_char(&wb, *c++, 1);
+        }
+        if (res < 0) {
+            return NULL;
+        }
+    }
+    return store_string(pl, wb.word ? wb.word : "", wb.word_len);
+
+}
+
+
+// Expands a word as written into zero or more items
+static int expand_word(expansion *ex, const char *raw) {
+
+    // Each argument of "$@" becomes an item of its own, even with blanks
+    // in it. Unquoted, the arguments are split like any other value
+    if (!strcmp(raw, "\"$@\"")) {
+        const param_list *params = get_params();
+        for (size_t i = 0; i < params->count; ++i) {
+            if (push_item(ex, params->args[i]) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    static word_builder wb;
+    if (build_word(&wb, raw, 1) < 0) {
+        return -1;
+    }
+
+    field_end from = { 0, 0, 0 };
+    for (size_t i = 0; i < wb.field_count; ++i) {
+        if (push_field(ex, &wb, &from, &wb.fields[i], 1) < 0) {
+            return -1;
+        }
+        from = wb.fields[i];
+    }
+    field_end last = { wb.word_len, wb.pattern_len, wb.wild };
+    return push_field(ex, &wb, &from, &last, wb.started);
+
+}
+
+
+// Adds the field of a word between from and to as an item, or the paths
+// it matches if it has wildcards. A field without characters or quotes
+// adds nothing
+static int push_field(expansion *ex, word_builder *wb, const field_end *from,
+                      const field_end *to, int started) {
+
+    if (!started) {
+        return 0;
+    }
+
+    if (to->wild) {
+        // The pattern is matched in place, ended where the field ends
+        char saved = wb->pattern[to->pattern_end];
+        wb->pattern[to->pattern_end] = '\0';
+        size_t matches_start = ex->count;
+        int matches = expand_wildcards(wb->pattern + from->pattern_end,
+                                       push_path, ex);
+        wb->pattern[to->pattern_end] = saved;
+        if (matches < 0) {
+            return -1;
+        }
+        if (matches > 0) {
+            qsort(ex->pl->exp_buf->start + matches_start, matches,
+                  sizeof(char *), item_cmp);
+            return 0;
+        }
+    }
+
+    char *word = store_string(ex->pl, wb->word + from->word_end,
+                              to->word_end - from->word_end);
+    if (word == NULL) {
+        return -1;
+    }
+    return push_item(ex, word);
+
+}
+
+
+// Goes through a word as written, removing quotes and escapes
+// and substituting $name and ${name} outside single quotes.
+// If split, values outside double quotes are split into fields
+static int build_word(word_builder *wb, const char *raw, int split) {
+
+    wb->word_len = 0;
+    wb->pattern_len = 0;
+    wb->quoted = 0;
+    wb->wild = 0;
+    wb->split = split;
+    wb->started = 0;
+    wb->field_count = 0;
+
+    char quote = '\0';
+    const char *c = raw;
+
+    while (*c != '\0') {
+        if (quote == SQUOTE) {
+            if (*c == SQUOTE) {
+                quote = '\0';
+            } else if (put_char(wb, *c, 1) < 0) {
+                return -1;
+            }
+            c++;
+            continue;
+        }
+
+        const char *name;
+        size_t len;
+        const char *next = param_ref(c, &name, &len);
+        if (next != NULL) {
+            if (put_param(wb, name, len, quote == DQUOTE) < 0) {
+                return -1;
+            }
+            c = next;
+            continue;
+        }
+
+        if (quote == DQUOTE) {
+            if (*c == DQUOTE) {
+                quote = '\0';
+            } else if (*c == ESCAPE && is_dq_escapable(c[1])) {
+                if (put_char(wb, *++c, 1) < 0) {
+                    return -1;
+                }
+            } else if (put_char(wb, *c, 1) < 0) {
+                return -1;
+            }
+        } else if (*c == SQUOTE || *c == DQUOTE) {
+            quote = *c;
+            wb->quoted = 1;
+            wb->started = 1;
+        } else if (*c == ESCAPE && c[1] != '\0') {
+            if (put_char(wb, *++c, 1) < 0) {
+                return -1;
+            }
+        } else if (put_char(wb, *c, 0) < 0) {
+            return -1;
+        }
+        c++;
+    }
+
+    // Both are kept null terminated
+    if (put_string(&wb->word, &wb->word_len, &wb->word_size, "", 1) < 0 ||
+        put_string(&wb->pattern, &wb->pattern_len, &wb->pattern_size,
+                   "", 1) < 0) {
+        return -1;
+    }
+    wb->word_len--;
+    wb->pattern_len--;
+
+    return 0;
+
+}
+
+
+// Checks if c starts with $name, ${name} or a special parameter. If so,
+// sets name and len to the name and returns where the reference ends.
+// Returns NULL otherwise, as for an unterminated ${
+static const char *param_ref(const char *c, const char **name, size_t *len) {
+
+    if (*c != '$' || !(is_name_start(c[1]) || c[1] == '{' ||
+                       is_special_param(c[1]))) {
+        return NULL;
+    }
+    int braced = c[1] == '{';
+    const char *start = c + 1 + braced;
+    const char *end = start;
+    if (braced) {
+        end = strchr(start, '}');
+    } else if (is_special_param(*start)) {
+        end = start + 1;
+    } else {
+        while (is_name_char(*end)) {
+            end++;
+        }
+    }
+    if (end == NULL) {
+        return NULL;
+    }
+    *name = start;
+    *len = end - start;
+    return end + braced;
+
+}
+
+
+// Adds the value of a variable or parameter to the word being built.
+// $@ gives the arguments of the function being run, separated by spaces,
+// and $? the status of the last command
+static int put_param(word_builder *wb, const char *name, size_t len,
+                     int quoted) {
+
+    const param_list *params = get_params();
+    const char *value;
+    char count[24];
+
+    if (len == 1 && *name == '@') {
+        for (size_t i = 0; i < params->count; ++i) {
+            if ((i > 0 && put_value(wb, " ", quoted) < 0) ||
+                put_value(wb, params->args[i], quoted) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (len == 1 && *name == '#') {
+        snprintf(count, sizeof(count), "%zu", params->count);
+        value = count;
+    } else if (len == 1 && *name == '?') {
+        snprintf(count, sizeof(count), "%d", get_last_status());
+        value = count;
+    } else if (strspn(name, "0123456789") >= len) {
+        size_t n = strtoul(name, NULL, 10);
+        value = n == 0 ? SHELL_NAME :
+                n <= params->count ? params->args[n - 1] : NULL;
+    } else {
+        value = get_var_n(name, len);
+    }
+    return put_value(wb, value, quoted);
+
+}
+
+
+// Adds a value to the word being built. Unquoted blanks in it end the
+// field being built, if that has been started, instead of being added
+static int put_value(word_builder *wb, const char *value, int quoted) {
+
+    for (; value && *value; ++value) {
+        int res;
+        if (!quoted && wb->split && is_blank(*value)) {
+            res = wb->started ? end_field(wb) : 0;
+        } else {
+            res = put_char(wb, *value, quoted);
+        }
+        if (res < 0) {
+            return -1;
+        }
+    }
+    return 0;
+
+}
+
+
+// Ends the field being built where the word and pattern are now
+static int end_field(word_builder *wb) {
+
+    if (wb->field_count == wb->field_size) {
+        size_t new_size = wb->field_size ? 2 * wb->field_size : 8;
+        field_end *grown = realloc(wb->fields, new_size * sizeof(field_end));
+        if (grown == NULL) {
+            return -1;
+        }
+        wb->fields = grown;
+        wb->field_size = new_size;
+    }
+    field_end *end = &wb->fields[wb->field_count++];
+    end->word_end = wb->word_len;
+    end->pattern_end = wb->pattern_len;
+    end->wild = wb->wild;
+    wb->wild = 0;
+    wb->started = 0;
+    return 0;
+
+}
+
+
+// Adds a character to the word being built. In the pattern,
+// quoted characters that would otherwise mean something are escaped
+static int put_char(word_builder *wb, char c, int quoted) {
+
+    wb->started = 1;
+    if (!quoted && is_wild(c)) {
+        wb->wild = 1;
+    }
+    if (quoted && (is_wild(c) || c == ESCAPE)) {
+        if (put_string(&wb->pattern, &wb->pattern_len, &wb->pattern_size,
+                       "\\", 1) < 0) {
+            return -1;
+        }
+    }
+    if (put_string(&wb->pattern, &wb->pattern_len, &wb->pattern_size,
+                   &c, 1) < 0) {
+        return -1;
+    }
+    return put_string(&wb->word, &wb->word_len, &wb->word_size, &c, 1);
+
+}
+
+
+// Appends n characters to a growing buffer
+static int put_string(char **buf, size_t *len, size_t *size,
+                      const char *s, size_t n) {
+
+    if (*len + n > *size) {
+        size_t new_size = *size ? 2 * *size : 256;
+        while (new_size < *len + n) {
+            new_size *= 2;
+        }
+        char *grown = realloc(*buf, new_size);
+        if (grown == NULL) {
+            return -1;
+        }
+        *buf = grown;
+        *size = new_size;
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    return 0;
+
+}
+
+
+static int push_item(expansion *ex, char *item) {
+
+    if (reserve_items(ex->pl->exp_buf, ex->count + 1) < 0) {
+        return -1;
+    }
+    ex->pl->exp_buf->start[ex->count++] = item;
+    return 0;
+
+}
+
+
+// Keeps a path matched by a wildcard word as an item
+static int push_path(void *ctx, const char *path, size_t len) {
+
+    expansion *ex = ctx;
+    char *copy = store_string(ex->pl, path, len);
+    if (copy == NULL) {
+        return -1;
+    }
+    return push_item(ex, copy);
+
+}
+
+
+static int item_cmp(const void *a, const void *b) {
+
+    return strcmp(*(char * const *) a, *(char * const *) b);
+
+}
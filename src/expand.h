@@ -0,0 +1,10 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+typedef struct pl parsed_line;
+
+int expand_line(parsed_line *pl);
+char *expand_single(parsed_line *pl, const char *raw);
+char *expand_text(parsed_line *pl, const char *raw);
+
+#endif
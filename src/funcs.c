@@ -0,0 +1,404 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "parser.h"
+#include "buffers.h"
+#include "stored.h"
+#include "script.h"
+#include "vars.h"
+#include "linecache.h"
+#include "funcs.h"
+
+// Aliases and functions are kept in two tables with chained buckets.
+// There are seldom many of either, so the tables do not grow
+static definition *aliases[DEF_BUCKETS];
+static definition *functions[DEF_BUCKETS];
+static size_t alias_count;
+
+// The items of a line, set aside while aliases are put into it
+static struct {
+    char **items;
+    unsigned char *flags;
+    size_t *lengths;
+    const stored_line **found;
+    size_t item_size;
+    size_t cmd_size;
+} saved;
+
+static definition **find_def(definition **table, const char *name,
+                             size_t len);
+static definition *add_def(definition **table, const char *name, size_t len);
+static void free_def(definition *d);
+static int save_line(parsed_line *pl, size_t item_count, size_t cmd_count);
+static void print_def(const definition *d);
+
+
+// Defines an alias for the commands of a pipeline, which is lexed and
+// stored right away. The lexing is done in the parse buffers, so whatever
+// line is in them is lost. Returns -1 if the text is not a plain pipeline
+// or memory runs out
+int define_alias(const char *name, size_t name_len, const char *text,
+                 parsed_line *pl) {
+
+    size_t len = strlen(text);
+    char *copy = malloc(2 * (len + 1));
+    if (copy == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    // Lexing writes to one copy, the other is kept for listing
+    memcpy(copy, text, len + 1);
+    memcpy(copy + len + 1, text, len + 1);
+
+    if (parse_raw(copy, pl) < 0) {
+        free(copy);
+        return -1;
+    }
+    if (pl->rstdin || pl->rstdout || pl->background) {
+        fprintf(stderr, "alias: %.*s cannot redirect or run in the "
+                "background\n", (int) name_len, name);
+        free(copy);
+        return -1;
+    }
+
+    stored_line *line = store_line(pl);
+    char *kept = malloc(len + 1);
+    if (line != NULL && kept != NULL) {
+        memcpy(kept, copy + len + 1, len + 1);
+    }
+    free(copy);
+
+    definition *d = line && kept ? add_def(aliases, name, name_len) : NULL;
+    if (d == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(line);
+        free(kept);
+        return -1;
+    }
+
+    alias_count += d->line == NULL;
+    free(d->text);
+    free(d->line);
+    d->text = kept;
+    d->line = line;
+    // Cached lines have the old meaning of the name in them
+    invalidate_line_cache();
+    return 0;
+
+}
+
+
+// Removes an alias. Returns -1 if there was none by the name
+int remove_alias(const char *name) {
+
+    definition **link = find_def(aliases, name, strlen(name));
+    if (*link == NULL) {
+        return -1;
+    }
+
+    definition *d = *link;
+    *link = d->next;
+    free_def(d);
+    alias_count--;
+    invalidate_line_cache();
+    return 0;
+
+}
+
+
+// Prints an alias the way it can be defined again.
+// Returns -1 if there is none by the name
+int print_alias(const char *name) {
+
+    definition *d = *find_def(aliases, name, strlen(name));
+    if (d == NULL) {
+        return -1;
+    }
+    print_def(d);
+    return 0;
+
+}
+
+
+void print_aliases() {
+
+    for (size_t i = 0; i < DEF_BUCKETS; ++i) {
+        for (definition *d = aliases[i]; d; d = d->next) {
+            print_def(d);
+        }
+    }
+
+}
+
+
+// Passes the name of each function and alias to visit, for completion
+void visit_definitions(void (*visit)(const char *name, void *ctx),
+                       void *ctx) {
+
+    for (size_t i = 0; i < DEF_BUCKETS; ++i) {
+        for (definition *d = functions[i]; d; d = d->next) {
+            visit(d->name, ctx);
+        }
+        for (definition *d = aliases[i]; d; d = d->next) {
+            visit(d->name, ctx);
+        }
+    }
+
+}
+
+
+// Replaces the first word of each command that names an alias with the
+// commands the alias stands for. The rest of the words are added to the
+// last of those. Works on a lexed line before expansion, so the words of
+// the alias are expanded along with the others. Returns -1 if out of memory
+int apply_aliases(parsed_line *pl) {
+
+    if (alias_count == 0) {
+        return 0;
+    }
+
+    command *first = pl->cmd_buf->start;
+    size_t cmd_count = pl->pipe_count + 1;
+    size_t item_count = 0;
+    size_t new_cmds = cmd_count;
+    size_t new_items = 0;
+    int any = 0;
+
+    for (size_t i = 0; i < cmd_count; ++i) {
+        item_count += first[i].length;
+    }
+    if (save_line(pl, item_count, cmd_count) < 0) {
+        return -1;
+    }
+
+    // A quoted or expanded name is never an alias
+    for (size_t i = 0; i < cmd_count; ++i) {
+        saved.found[i] = NULL;
+        size_t pos = first[i].items - pl->item_buf->start;
+        if (first[i].length == 0 || pl->item_buf->flags[pos]) {
+            continue;
+        }
+        const char *name = first[i].items[0];
+        definition *d = *find_def(aliases, name, strlen(name));
+        if (d != NULL) {
+            saved.found[i] = d->line;
+            new_cmds += d->line->cmd_count - 1;
+            new_items += d->line->item_count - 1;
+            any = 1;
+        }
+    }
+    if (!any) {
+        return 0;
+    }
+
+    if (check_buffers(pl, item_count + new_items, new_cmds - 1) < 0) {
+        return -1;
+    }
+
+    command *cmd = pl->cmd_buf->start;
+    char **items = pl->item_buf->start;
+    unsigned char *flags = pl->item_buf->flags;
+    size_t in = 0;    // Position among the saved items
+    size_t depth = 0;
+
+    for (size_t i = 0; i < cmd_count; ++i) {
+        const stored_line *alias = saved.found[i];
+        uint32_t alias_cmds = alias ? alias->cmd_count : 1;
+        uint32_t alias_item = 0;
+
+        for (uint32_t k = 0; k < alias_cmds; ++k, ++cmd, ++depth) {
+            cmd->items = items;
+            cmd->length = 0;
+            cmd->pipe_depth = depth;
+            // Pipeline should appear in reverse order when executing
+            cmd->next = depth > 0 ? cmd - 1 : NULL;
+
+            uint32_t length = alias ? stored_length(alias, k) : 0;
+            for (uint32_t j = 0; j < length; ++j, ++alias_item) {
+                *items++ = stored_item(alias, alias_item);
+                *flags++ = stored_flags(alias, alias_item);
+            }
+            cmd->length = length;
+
+            // The words after the alias name go to its last command
+            if (k == alias_cmds - 1) {
+                for (size_t j = alias != NULL; j < saved.lengths[i]; ++j) {
+                    *items++ = saved.items[in + j];
+                    *flags++ = saved.flags[in + j];
+                    cmd->length++;
+                }
+            }
+            *items++ = NULL;
+            flags++;
+        }
+        in += saved.lengths[i] + 1;
+    }
+
+    pl->cmd = cmd - 1;
+    pl->pipe_count = depth - 1;
+    return 0;
+
+}
+
+
+// Makes body the function called name, replacing any earlier one.
+// The table takes a reference to the body. Returns -1 if out of memory
+int define_function(const char *name, node *body) {
+
+    definition *d = add_def(functions, name, strlen(name));
+    if (d == NULL) {
+        return -1;
+    }
+    // A function may be running when it is defined again
+    if (d->body) {
+        release_node(d->body);
+    }
+    d->body = retain_node(body);
+    return 0;
+
+}
+
+
+// Returns the body of a function, or NULL if there is none by the name
+node *find_function(const char *name) {
+
+    definition *d = *find_def(functions, name, strlen(name));
+    return d ? d->body : NULL;
+
+}
+
+
+// Removes a function. Returns -1 if there was none by the name
+int remove_function(const char *name) {
+
+    definition **link = find_def(functions, name, strlen(name));
+    if (*link == NULL) {
+        return -1;
+    }
+
+    definition *d = *link;
+    *link = d->next;
+    release_node(d->body);
+    free_def(d);
+    return 0;
+
+}
+
+
+// Returns the link to the definition called name in a table, which points
+// to NULL if there is none
+static definition **find_def(definition **table, const char *name,
+                             size_t len) {
+
+    unsigned int hash = hash_name(name, len);
+    definition **link = &table[hash & (DEF_BUCKETS - 1)];
+    for (; *link; link = &(*link)->next) {
+        definition *d = *link;
+        if (d->hash == hash && !strncmp(d->name, name, len) &&
+            d->name[len] == '\0') {
+            break;
+        }
+    }
+    return link;
+
+}
+
+
+// Returns the definition called name in a table, adding an empty one if
+// there is none. Returns NULL if out of memory
+static definition *add_def(definition **table, const char *name,
+                           size_t len) {
+
+    definition **link = find_def(table, name, len);
+    if (*link != NULL) {
+        return *link;
+    }
+
+    definition *d = calloc(1, sizeof(definition));
+    char *copy = malloc(len + 1);
+    if (d == NULL || copy == NULL) {
+        free(d);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    d->hash = hash_name(name, len);
+    d->name = copy;
+    *link = d;
+    return d;
+
+}
+
+
+static void free_def(definition *d) {
+
+    free(d->name);
+    free(d->text);
+    free(d->line);
+    free(d);
+
+}
+
+
+// Copies the items, flags and command lengths of a line aside
+static int save_line(parsed_line *pl, size_t item_count, size_t cmd_count) {
+
+    size_t total = item_count + cmd_count; // With the NULL of each command
+
+    if (total > saved.item_size) {
+        char **items = realloc(saved.items, total * sizeof(char *));
+        if (items != NULL) {
+            saved.items = items;
+        }
+        unsigned char *flags = realloc(saved.flags, total);
+        if (flags != NULL) {
+            saved.flags = flags;
+        }
+        if (items == NULL || flags == NULL) {
+            return -1;
+        }
+        saved.item_size = total;
+    }
+    if (cmd_count > saved.cmd_size) {
+        size_t *lengths = realloc(saved.lengths, cmd_count * sizeof(size_t));
+        if (lengths != NULL) {
+            saved.lengths = lengths;
+        }
+        const stored_line **found = realloc(saved.found,
+                                            cmd_count * sizeof(*found));
+        if (found != NULL) {
+            saved.found = found;
+        }
+        if (lengths == NULL || found == NULL) {
+            return -1;
+        }
+        saved.cmd_size = cmd_count;
+    }
+
+    memcpy(saved.items, pl->item_buf->start, total * sizeof(char *));
+    memcpy(saved.flags, pl->item_buf->flags, total);
+    command *first = pl->cmd_buf->start;
+    for (size_t i = 0; i < cmd_count; ++i) {
+        saved.lengths[i] = first[i].length;
+    }
+    return 0;
+
+}
+
+
+// Prints an alias in single quotes, closing them around any quote in it
+static void print_def(const definition *d) {
+
+    printf("alias %s='", d->name);
+    for (const char *c = d->text; *c; ++c) {
+        if (*c == SQUOTE) {
+            printf("'\\''");
+        } else {
+            putchar(*c);
+        }
+    }
+    printf("'\n");
+
+}
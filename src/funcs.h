@@ -0,0 +1,35 @@
+#ifndef FUNCS_H
+#define FUNCS_H
+
+#include <stddef.h>
+
+#define DEF_BUCKETS 64 // Buckets of the function and alias tables, a power
+                       // of two
+
+typedef struct n node;
+typedef struct sl stored_line;
+typedef struct pl parsed_line;
+
+// A function or an alias, compiled when it was defined
+typedef struct d {
+    struct d *next;     // Next definition in the same bucket
+    unsigned int hash;
+    char *name;
+    char *text;         // Alias: the value as given, for listing
+    stored_line *line;  // Alias: the commands it stands for
+    node *body;         // Function: the commands it runs
+} definition;
+
+int define_alias(const char *name, size_t name_len, const char *text,
+                 parsed_line *pl);
+int remove_alias(const char *name);
+int print_alias(const char *name);
+void print_aliases();
+int apply_aliases(parsed_line *pl);
+void visit_definitions(void (*visit)(const char *name, void *ctx),
+                       void *ctx);
+int define_function(const char *name, node *body);
+node *find_function(const char *name);
+int remove_function(const char *name);
+
+#endif
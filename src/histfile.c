@@ -0,0 +1,432 @@
+#define _GNU_SOURCE // memmem
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "histfile.h"
+
+// The history file is a plain list of lines that sessions only ever append
+// to. It is mapped into memory instead of read, and entries are located
+// through an index of their offsets that is built the first time it is
+// needed and then extended as the file grows.
+static struct {
+    int fd;
+    char *map;
+    size_t map_size;
+    size_t *offsets;     // Where each complete entry starts
+    size_t count;        // Number of entries in offsets
+    size_t cap;
+    size_t indexed;      // Bytes of the file covered by offsets
+    size_t *sorted;      // Entry numbers ordered by text, for prefix search
+    size_t sorted_count;
+} hist = { .fd = -1 };
+
+static int remap();
+static int index_entries();
+static int sort_entries();
+static size_t entry_len(size_t i);
+static int entry_cmp(size_t i, const char *text, size_t len);
+static int sorted_cmp(const void *a, const void *b);
+static int num_cmp(const void *a, const void *b);
+
+
+// Opens (or creates) the history file at path for appending and searching.
+// Nothing is read until the history is actually used
+int hist_open(const char *path) {
+
+    hist.fd = open(path, O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC, S_IRUSR|S_IWUSR);
+    return hist.fd < 0 ? -1 : 0;
+
+}
+
+
+// Adds a line at the end of the history file. The entry is written with
+// a single call under a lock, so concurrent sessions never interleave
+int hist_append(const char *line) {
+
+    if (hist.fd < 0) {
+        return -1;
+    }
+
+    // An entry of several lines is kept on one line of the file
+    size_t len = strlen(line);
+    char *copy = NULL;
+    if (memchr(line, '\n', len)) {
+        copy = strdup(line);
+        if (copy == NULL) {
+            return -1;
+        }
+        for (char *nl = copy; (nl = strchr(nl, '\n')); nl++) {
+            *nl = HIST_NEWLINE;
+        }
+        line = copy;
+    }
+
+    struct iovec iov[2] = {
+        { (void *) line, len },
+        { "\n", 1 }
+    };
+
+    flock(hist.fd, LOCK_EX);
+    ssize_t written = writev(hist.fd, iov, 2);
+    flock(hist.fd, LOCK_UN);
+
+    free(copy);
+    return written < 0 ? -1 : 0;
+
+}
+
+
+// Passes the last count entries, oldest first, to add. Only the end of the
+// file is scanned, so this is cheap regardless of the size of the history
+void hist_load_recent(size_t count, void (*add)(const char *)) {
+
+    if (remap() < 0 || hist.map_size == 0 || count == 0) {
+        return;
+    }
+
+    // Ignore an incomplete last line being written by another session
+    char *end = hist.map + hist.map_size;
+    while (end > hist.map && end[-1] != '\n') {
+        end--;
+    }
+
+    char *start = end;
+    size_t found = 0;
+    while (start > hist.map && found <= count) {
+        start--;
+        if (start == hist.map || start[-1] == '\n') {
+            found++;
+        }
+    }
+    if (found > count) {
+        // Went one entry too far
+        start = (char *) memchr(start, '\n', end - start) + 1;
+    }
+
+    char *entry = NULL;
+    size_t entry_size = 0;
+    while (start < end) {
+        char *nl = memchr(start, '\n', end - start);
+        size_t len = nl - start;
+        if (len + 1 > entry_size) {
+            char *grown = realloc(entry, len + 1);
+            if (grown == NULL) {
+                break;
+            }
+            entry = grown;
+            entry_size = len + 1;
+        }
+        memcpy(entry, start, len);
+        entry[len] = '\0';
+        for (char *sep = entry; (sep = strchr(sep, HIST_NEWLINE)); sep++) {
+            *sep = '\n';
+        }
+        add(entry);
+        start = nl + 1;
+    }
+
+    free(entry);
+
+}
+
+
+// Visits the last count entries, oldest first.
+// Returns the number of entries visited
+size_t hist_tail(size_t count, hist_visit visit) {
+
+    if (remap() < 0 || index_entries() < 0) {
+        return 0;
+    }
+
+    size_t first = count < hist.count ? hist.count - count : 0;
+    for (size_t i = first; i < hist.count; ++i) {
+        visit(i + 1, hist.map + hist.offsets[i], entry_len(i));
+    }
+
+    return hist.count - first;
+
+}
+
+
+// Visits every entry starting with or containing needle, oldest first.
+// Returns the number of entries visited
+size_t hist_search(enum hist_match how, const char *needle,
+                   hist_visit visit) {
+
+    if (remap() < 0 || index_entries() < 0) {
+        return 0;
+    }
+
+    size_t needle_len = strlen(needle);
+    size_t *found = NULL;
+    size_t found_count = 0;
+
+    if (how == MATCH_PREFIX) {
+        if (sort_entries() < 0) {
+            return 0;
+        }
+        // Entries with the prefix form a range in sorted order
+        size_t lo = 0, hi = hist.sorted_count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (entry_cmp(hist.sorted[mid], needle, needle_len) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        size_t end = lo;
+        while (end < hist.sorted_count &&
+               entry_len(hist.sorted[end]) >= needle_len &&
+               !memcmp(hist.map + hist.offsets[hist.sorted[end]],
+                       needle, needle_len)) {
+            end++;
+        }
+
+        found_count = end - lo;
+        found = malloc((found_count + 1) * sizeof(size_t));
+        if (found == NULL) {
+            return 0;
+        }
+        memcpy(found, hist.sorted + lo, found_count * sizeof(size_t));
+        qsort(found, found_count, sizeof(size_t), num_cmp);
+
+    } else {
+        // The entries are contiguous in the map, so search it all at once
+        // and work out which entry each hit belongs to
+        size_t found_cap = 64;
+        found = malloc(found_cap * sizeof(size_t));
+        if (found == NULL) {
+            return 0;
+        }
+        size_t pos = 0;
+        while (pos < hist.indexed) {
+            char *hit = memmem(hist.map + pos, hist.indexed - pos,
+                               needle, needle_len);
+            if (hit == NULL) {
+                break;
+            }
+            size_t off = hit - hist.map;
+            size_t lo = 0, hi = hist.count;
+            while (hi - lo > 1) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (hist.offsets[mid] <= off) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+            // A hit spanning a line break is not a match
+            if (off + needle_len <= hist.offsets[lo] + entry_len(lo)) {
+                if (found_count == found_cap) {
+                    found_cap *= 2;
+                    size_t *grown = realloc(found, found_cap * sizeof(size_t));
+                    if (grown == NULL) {
+                        break;
+                    }
+                    found = grown;
+                }
+                found[found_count++] = lo;
+                pos = hist.offsets[lo] + entry_len(lo) + 1;
+            } else {
+                pos = off + 1;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < found_count; ++i) {
+        visit(found[i] + 1, hist.map + hist.offsets[found[i]],
+              entry_len(found[i]));
+    }
+
+    free(found);
+    return found_count;
+
+}
+
+
+// Closes the history file and drops the index, so it can be opened again
+void hist_close() {
+
+    if (hist.map) {
+        munmap(hist.map, hist.map_size);
+    }
+    if (hist.fd >= 0) {
+        close(hist.fd);
+    }
+    free(hist.offsets);
+    free(hist.sorted);
+    memset(&hist, 0, sizeof(hist));
+    hist.fd = -1;
+
+}
+
+
+// Makes the map cover the whole file, which other sessions may have grown.
+// Everything that reads the map calls this first, so a file another session
+// has cut short is never read past its end, which would raise SIGBUS
+static int remap() {
+
+    if (hist.fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(hist.fd, &st) < 0) {
+        return -1;
+    }
+    size_t size = st.st_size;
+    if (size == hist.map_size) {
+        return 0;
+    }
+
+    // The file only ever grows by appending, so one that shrank was
+    // rewritten behind our back and the index is useless
+    if (size < hist.map_size || size < hist.indexed) {
+        hist.count = 0;
+        hist.indexed = 0;
+        hist.sorted_count = 0;
+    }
+
+    if (hist.map) {
+        munmap(hist.map, hist.map_size);
+        hist.map = NULL;
+        hist.map_size = 0;
+    }
+
+    if (size > 0) {
+        char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, hist.fd, 0);
+        if (map == MAP_FAILED) {
+            return -1;
+        }
+        hist.map = map;
+        hist.map_size = size;
+    }
+
+    return 0;
+
+}
+
+
+// Extends the offset index with the complete entries added since last time
+static int index_entries() {
+
+    char *pos = hist.map + hist.indexed;
+    char *end = hist.map + hist.map_size;
+    char *nl;
+
+    while (pos < end && (nl = memchr(pos, '\n', end - pos)) != NULL) {
+        if (hist.count == hist.cap) {
+            size_t cap = hist.cap ? 2 * hist.cap : 1024;
+            size_t *grown = realloc(hist.offsets, cap * sizeof(size_t));
+            if (grown == NULL) {
+                return -1;
+            }
+            hist.offsets = grown;
+            hist.cap = cap;
+        }
+        hist.offsets[hist.count++] = pos - hist.map;
+        pos = nl + 1;
+        hist.indexed = pos - hist.map;
+    }
+
+    return 0;
+
+}
+
+
+// Brings the sorted order up to date by sorting the entries added since
+// last time and merging them with the ones already sorted
+static int sort_entries() {
+
+    if (hist.sorted_count == hist.count) {
+        return 0;
+    }
+
+    size_t *grown = realloc(hist.sorted, hist.cap * sizeof(size_t));
+    if (grown == NULL) {
+        return -1;
+    }
+    hist.sorted = grown;
+
+    size_t old_count = hist.sorted_count;
+    size_t new_count = hist.count - old_count;
+    size_t *fresh = hist.sorted + old_count;
+    for (size_t i = 0; i < new_count; ++i) {
+        fresh[i] = old_count + i;
+    }
+    qsort(fresh, new_count, sizeof(size_t), sorted_cmp);
+
+    if (old_count > 0) {
+        size_t *merged = malloc(hist.count * sizeof(size_t));
+        if (merged == NULL) {
+            return -1;
+        }
+        size_t a = 0, b = 0, m = 0;
+        while (a < old_count && b < new_count) {
+            if (sorted_cmp(&hist.sorted[a], &fresh[b]) <= 0) {
+                merged[m++] = hist.sorted[a++];
+            } else {
+                merged[m++] = fresh[b++];
+            }
+        }
+        while (a < old_count) {
+            merged[m++] = hist.sorted[a++];
+        }
+        while (b < new_count) {
+            merged[m++] = fresh[b++];
+        }
+        memcpy(hist.sorted, merged, hist.count * sizeof(size_t));
+        free(merged);
+    }
+
+    hist.sorted_count = hist.count;
+    return 0;
+
+}
+
+
+// Length of entry i, not counting its newline
+static size_t entry_len(size_t i) {
+
+    size_t next = i + 1 < hist.count ? hist.offsets[i + 1] : hist.indexed;
+    return next - hist.offsets[i] - 1;
+
+}
+
+
+// Compares entry i with a string that is not necessarily null terminated
+static int entry_cmp(size_t i, const char *text, size_t len) {
+
+    size_t i_len = entry_len(i);
+    int res = memcmp(hist.map + hist.offsets[i], text,
+                     i_len < len ? i_len : len);
+    if (res != 0) {
+        return res;
+    }
+    return (i_len > len) - (i_len < len);
+
+}
+
+
+static int sorted_cmp(const void *a, const void *b) {
+
+    size_t j = *(const size_t *) b;
+    return entry_cmp(*(const size_t *) a, hist.map + hist.offsets[j],
+                     entry_len(j));
+
+}
+
+
+static int num_cmp(const void *a, const void *b) {
+
+    size_t x = *(const size_t *) a;
+    size_t y = *(const size_t *) b;
+    return (x > y) - (x < y);
+
+}
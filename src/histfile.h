@@ -0,0 +1,26 @@
+#ifndef HISTFILE_H
+#define HISTFILE_H
+
+#include <stddef.h>
+
+#define HISTORY_RECENT 1000 // Entries handed to readline for navigation
+#define HIST_NEWLINE '\x1f' // Stands for a newline within an entry in the file
+
+enum hist_match {
+    MATCH_PREFIX,
+    MATCH_SUBSTRING
+};
+
+// Called with the number and text of each entry found.
+// The text is not null terminated, so its length is given.
+typedef void (*hist_visit)(size_t num, const char *entry, size_t len);
+
+int hist_open(const char *path);
+int hist_append(const char *line);
+void hist_load_recent(size_t count, void (*add)(const char *));
+size_t hist_tail(size_t count, hist_visit visit);
+size_t hist_search(enum hist_match how, const char *needle,
+                   hist_visit visit);
+void hist_close();
+
+#endif
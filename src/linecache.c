@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vars.h"
+#include "script.h"
+#include "linecache.h"
+
+// The cached lines, in a hash table with chained buckets and in a list
+// ordered by when they were last run
+static struct {
+    cache_entry *buckets[LINE_CACHE_BUCKETS];
+    cache_entry *newest;
+    cache_entry *oldest;
+    size_t count;
+    unsigned long hits;
+    unsigned long misses;
+    int stale; // The lines would lex differently now
+} cache;
+
+static void unlink_entry(cache_entry *e);
+static void push_newest(cache_entry *e);
+static void clear_cache();
+
+
+// Returns the entry of a line that was run before and marks it as the most
+// recently run, or NULL if it is not cached
+cache_entry *find_cached_line(const char *text, size_t len) {
+
+    if (cache.stale) {
+        clear_cache();
+        cache.stale = 0;
+    }
+
+    unsigned int hash = hash_name(text, len);
+    cache_entry *e = cache.buckets[hash & (LINE_CACHE_BUCKETS - 1)];
+    for (; e; e = e->next) {
+        if (e->hash == hash && e->len == len && !memcmp(e->text, text, len)) {
+            unlink_entry(e);
+            push_newest(e);
+            cache.hits++;
+            return e;
+        }
+    }
+    cache.misses++;
+    return NULL;
+
+}
+
+
+// Makes an entry for a line that is about to be lexed, which changes it,
+// so the text is copied first. Returns NULL if out of memory
+cache_entry *new_cache_entry(const char *text, size_t len) {
+
+    cache_entry *e = calloc(1, sizeof(cache_entry) + len + 1);
+    if (e == NULL) {
+        return NULL;
+    }
+    e->hash = hash_name(text, len);
+    e->len = len;
+    memcpy(e->text, text, len + 1);
+    return e;
+
+}
+
+
+// Adds an entry, which has been given its stored line or compiled list.
+// If the cache is full, the line run least recently is dropped
+void cache_line(cache_entry *e) {
+
+    if (cache.count == LINE_CACHE_SIZE) {
+        cache_entry *old = cache.oldest;
+        cache_entry **link = &cache.buckets[old->hash &
+                                            (LINE_CACHE_BUCKETS - 1)];
+        while (*link != old) {
+            link = &(*link)->next;
+        }
+        *link = old->next;
+        unlink_entry(old);
+        free_cache_entry(old);
+        cache.count--;
+    }
+
+    cache_entry **bucket = &cache.buckets[e->hash & (LINE_CACHE_BUCKETS - 1)];
+    e->next = *bucket;
+    *bucket = e;
+    push_newest(e);
+    cache.count++;
+
+}
+
+
+void free_cache_entry(cache_entry *e) {
+
+    free(e->line);
+    release_node(e->list);
+    free(e);
+
+}
+
+
+// Forgets all lines once the one being run is done, for when aliases
+// change. The line being run may be one of them, so nothing is freed yet
+void invalidate_line_cache() {
+
+    cache.stale = 1;
+
+}
+
+
+void print_line_cache() {
+
+    printf("%lu hits, %lu misses, %zu of %d lines cached\n",
+           cache.hits, cache.misses, cache.count, LINE_CACHE_SIZE);
+
+}
+
+
+static void unlink_entry(cache_entry *e) {
+
+    if (e->newer) {
+        e->newer->older = e->older;
+    } else {
+        cache.newest = e->older;
+    }
+    if (e->older) {
+        e->older->newer = e->newer;
+    } else {
+        cache.oldest = e->newer;
+    }
+    e->newer = e->older = NULL;
+
+}
+
+
+static void push_newest(cache_entry *e) {
+
+    e->older = cache.newest;
+    e->newer = NULL;
+    if (cache.newest) {
+        cache.newest->newer = e;
+    } else {
+        cache.oldest = e;
+    }
+    cache.newest = e;
+
+}
+
+
+static void clear_cache() {
+
+    while (cache.oldest) {
+        cache_entry *e = cache.oldest;
+        unlink_entry(e);
+        free_cache_entry(e);
+    }
+    memset(cache.buckets, 0, sizeof(cache.buckets));
+    cache.count = 0;
+
+}
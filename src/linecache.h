@@ -0,0 +1,34 @@
+#ifndef LINECACHE_H
+#define LINECACHE_H
+
+#include <stddef.h>
+
+// Lines kept, however long each is; there is no limit on their bytes.
+// The least recently run go first
+#define LINE_CACHE_SIZE    256
+#define LINE_CACHE_BUCKETS 512 // A power of two
+
+typedef struct n node;
+typedef struct sl stored_line;
+
+// A line run before, kept as it was lexed or compiled and looked up by its
+// text, so running it again skips both
+typedef struct ce {
+    struct ce *next;    // Next entry in the same bucket
+    struct ce *newer;   // Neighbours in the order they were last run
+    struct ce *older;
+    unsigned int hash;
+    size_t len;
+    stored_line *line;  // A single pipeline, before expansion
+    node *list;         // Anything else, compiled
+    char text[];
+} cache_entry;
+
+cache_entry *find_cached_line(const char *text, size_t len);
+cache_entry *new_cache_entry(const char *text, size_t len);
+void cache_line(cache_entry *e);
+void free_cache_entry(cache_entry *e);
+void invalidate_line_cache();
+void print_line_cache();
+
+#endif
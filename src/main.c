@@ -1,36 +1,56 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <fcntl.h>
 #include <signal.h>
-#include <sys/stat.h>
 #include <limits.h>
 #include "buffers.h"
 #include "parser.h"
+#include "histfile.h"
+#include "complete.h"
+#include "vars.h"
+#include "script.h"
+#include "zygote.h"
+#include "server.h"
 #include "builtins.h"
+#include "workdir.h"
 
-void sigint_handler(int);
-void interpret_command_line(parsed_line *pl);
-void prepare_pipeline(parsed_line *pl);
-void prepare_command_node(command *cmd, char *in);
-void execute_command(char **items);
+#define HISTORY_FILE ".bunsh_history"
+#define MORE_PROMPT  "> " // While a compound command is not finished
+
+extern char **environ;
 
-// Foreground processes running commands are interrupted on SIGINT,
-// but the shell process ignores it
+void sigint_handler(int);
+void open_history();
+void run_input(char *line, parsed_line *pl);
+static char *read_line(const char *prompt);
+static void keep_input();
+static int grow_input(char **text, char **work, size_t *size, size_t want);
+
+static int interactive; // Input comes from a terminal
+static char *input;     // The lines being run, as read, since running them
+                        // changes them
+
+// Foreground processes running commands are interrupted on SIGINT.
+// The shell process only stops the list or loop it is running
 void sigint_handler(int signal) {
+
+    interrupt_commands();
+
 }
 
 
-int main(void) {
+int main(int argc, char **argv) {
+
+    // A zygote waits to become a command before doing anything else
+    if (argc == 2 && !strcmp(argv[1], ZYGOTE_ARG)) {
+        zygote_main(ZYGOTE_FD);
+    }
 
     signal(SIGINT, sigint_handler);
     parsed_line pl;
-    char *prompt;
-    char work_dir[PATH_MAX];
     char *line = NULL;
     int res;
 
@@ -40,163 +60,181 @@ int main(void) {
         fprintf(stderr, "Could not initialize buffers\n");
         exit(EXIT_FAILURE);
     }
+    if (init_vars(environ) < 0) {
+        fprintf(stderr, "Could not initialize variables\n");
+        exit(EXIT_FAILURE);
+    }
+    init_work_dir();
+
+    // A server takes its lines from clients instead of a terminal
+    if (argc == 3 && !strcmp(argv[1], SERVE_ARG)) {
+        exit(serve(argv[2], &pl) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    var_changed(ZYGOTE_VAR, strlen(ZYGOTE_VAR));
+
+    // Line editing, history and completion of command names are only of
+    // use to someone typing, and a script starts faster without them
+    interactive = isatty(STDIN_FILENO);
+    if (interactive) {
+        open_history();
+        rl_attempted_completion_function = complete_command;
+        set_run_hook(keep_input);
+        start_exec_index();
+    } else {
+        // Commands the shell runs read the rest of the input themselves
+        setvbuf(stdin, NULL, _IONBF, 0);
+    }
 
     int done = 0;
 
     // Shell loop
     do {
-        getcwd(work_dir, PATH_MAX);
-        prompt = strncat(work_dir, "> ", 2);
-        line = readline(prompt);
-        add_history(line);
+        line = read_line(get_prompt());
 
         if (!line) { // EOF
             done = 1;
-        } else if (!*line) {
+        } else if (!line[strspn(line, " \t")]) {
             ; // Do nothing on empty string
         } else {
-            res = parse(line, &pl);
-            if (res < 0) {
-                fprintf(stderr, "Parse error\n");
-            } else {
-                interpret_command_line(&pl);
-            }
-        }
-
-        if (line) {
-            free(line);
+            run_input(line, &pl);
         }
 
     } while (!done);
 
+    hist_close();
     free_buffers(&pl);
     return 0;
 
 }
 
 
-void interpret_command_line(parsed_line *pl) {
+// Runs a line of input. While a compound command in it is not finished,
+// more lines are read, and the whole is run as if written on one line
+// with newlines between. The whole is kept in the history as one entry
+void run_input(char *line, parsed_line *pl) {
 
-    // Built-in commands relate to the shell process,
-    // so just execute and return to loop
-    builtin_fun_ptr f;
-    f = try_builtin(pl);
-    if (f) {
-        (*f)(pl);
+    static char *work = NULL; // A copy of the input to run
+    static size_t size = 0;
+    size_t len = strlen(line);
+
+    if (grow_input(&input, &work, &size, len + 1) < 0) {
         return;
     }
+    memcpy(input, line, len + 1);
+    int res = run_line(line, pl);
+
+    while (res == LINE_INCOMPLETE) {
+        char *more = read_line(MORE_PROMPT);
+        if (more == NULL) {
+            // Keep what was typed of the unfinished command
+            keep_input();
+            break;
+        }
 
-    // Otherwise, run the commands in a child process
-    pid_t pid = fork();
-
-    if (pid == -1) {
-        fprintf(stderr,"Fork error\n");
-    } else if (pid != 0) {
-        // Parent (shell)
-        waitpid(pid, NULL, 0);
-    } else {
-        // Child
-        if (pl->background) {
-            // Background processes fork again and their children
-            // (that do exec()) are inherited by init
-            pid_t pidbg = fork();
-            if (pidbg != 0) {
-                exit(0);
-            }
-            setpgid(0, 0); // Makes it not receive SIGINT from Ctrl-C
+        size_t more_len = strlen(more);
+        if (grow_input(&input, &work, &size, len + more_len + 2) < 0) {
+            return;
         }
-        prepare_pipeline(pl);
+        input[len] = '\n';
+        memcpy(input + len + 1, more, more_len + 1);
+        len += more_len + 1;
+
+        memcpy(work, input, len + 1);
+        res = run_line(work, pl);
+    }
+
+    if (res < 0) {
+        fprintf(stderr, "Parse error\n");
     }
 
 }
 
 
-// Sets up overall output and calls another function to process
-// the individual command nodes of a parsed command line
-void prepare_pipeline(parsed_line *pl) {
+// Reads a line of input, with readline and the prompt for someone typing,
+// and without either otherwise. The line is kept until the next call.
+// Returns NULL at the end of the input
+static char *read_line(const char *prompt) {
 
-    if (pl->rstdout) {
-        int fd = open(pl->rstdout, O_CREAT|O_WRONLY, S_IRUSR|S_IWUSR);
-        if (fd == -1) {
-            fprintf(stderr, "Unable to open file %s\n", pl->rstdout);
-            exit(EXIT_FAILURE);
-        }
-        dup2(fd, 1); // Sets stdout for this process to specified file
+    static char *line = NULL;
+    static size_t size = 0;
+
+    if (interactive) {
+        free(line);
+        line = readline(prompt);
+        return line;
+    }
+
+    ssize_t len = getline(&line, &size, stdin);
+    if (len < 0) {
+        return NULL;
+    }
+    if (len > 0 && line[len - 1] == '\n') {
+        line[len - 1] = '\0';
     }
-    prepare_command_node(pl->cmd, pl->rstdin);
+    return line;
 
 }
 
 
-// If cmd is not last in the pipeline, a fork is performed where the parent
-// executes the current command with the child's output as input,
-// and the child continues recursively to the next node.
-// The specified redirection of stdin is included as a parameter, because the
-// last forked process is the one that will be using it.
-void prepare_command_node(command *cmd, char *in) {
-
-    if (cmd->next == NULL) { // Last in the chain should not fork further
-        if (in) {
-            int fd = open(in, O_RDONLY);
-            struct stat buffer;
-            if (stat(in, &buffer) == -1 || fd == -1) {
-                fprintf(stderr, "Unable to open file %s\n", in);
-                exit(EXIT_FAILURE);
-            }
-            dup2(fd, 0); // Sets stdin for this process to specified file
-        }
-        execute_command(cmd->items);
+// Adds the input that was typed to the history. Called by run_line once
+// the input is complete, before it runs
+static void keep_input() {
+
+    if (interactive) {
+        add_history(input);
+        hist_append(input);
     }
 
-   // Sets up pipe through which the process with the current command and
-   // the process with the next can communicate
-    int p[2], pid;
-    pipe(p);
-    pid = fork();
+}
 
-    if (pid == -1) {
-        fprintf(stderr, "Fork error\n");
-        exit(EXIT_FAILURE);
 
-    } else if (pid != 0) {
-        // Parent
-        dup2(p[0], 0); // Read from child's output
-        close(p[0]);
-        close(p[1]);
-        waitpid(pid, NULL, 0);
-        execute_command(cmd->items);
+// Makes room for want characters in both input buffers
+static int grow_input(char **text, char **work, size_t *size, size_t want) {
 
-    } else {
-        // Child
-        dup2(p[1], 1); // Write to parent's input
-        close(p[0]);
-        close(p[1]);
-        prepare_command_node(cmd->next, in);
+    if (want <= *size) {
+        return 0;
+    }
+    size_t new_size = *size ? *size : 256;
+    while (new_size < want) {
+        new_size *= 2;
     }
 
+    char *grown_text = realloc(*text, new_size);
+    if (grown_text != NULL) {
+        *text = grown_text;
+    }
+    char *grown_work = realloc(*work, new_size);
+    if (grown_work != NULL) {
+        *work = grown_work;
+    }
+    if (grown_text == NULL || grown_work == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    *size = new_size;
+    return 0;
+
 }
 
 
-// Executes a single command in the calling process
-void execute_command(char **items) {
+// Opens the history file given by $HISTFILE or ~/.bunsh_history and gives
+// readline the most recent entries. The rest stay on disk until searched
+void open_history() {
 
-    size_t argc = 0;
-    while (*items != NULL) {
-        argc++;
-        items++;
-    }
-    items -= argc;
+    char path[PATH_MAX];
+    const char *file = get_var("HISTFILE");
+    const char *home = get_var("HOME");
 
-    char *argv[argc+1];
-    argv[argc] = NULL;
-    for (size_t i = 0; i < argc; ++i, ++items) {
-        argv[i] = *items;
+    if (file == NULL && home != NULL) {
+        snprintf(path, PATH_MAX, "%s/%s", home, HISTORY_FILE);
+        file = path;
+    }
+    if (file == NULL || hist_open(file) < 0) {
+        return;
     }
 
-    execvp(argv[0], argv);
-
-    // execvp failed
-    fprintf(stderr, "Unknown or malformatted command: %s\n", argv[0]);
-    exit(EXIT_FAILURE);
+    stifle_history(HISTORY_RECENT); // Keeps readline's own list short
+    hist_load_recent(HISTORY_RECENT, add_history);
 
 }
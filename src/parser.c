@@ -5,19 +5,27 @@
 #include <ctype.h>
 #include "parser.h"
 #include "buffers.h"
+#include "expand.h"
+#include "vars.h"
+#include "wildcard.h"
 
-#define PIPE  ('|')
-#define RDOUT ('>')
-#define RDIN  ('<')
-#define BG    ('&')
+#define is_id(c)     (!is_spec(c) && !isspace(c))
 
-#define is_pipe(c)   ((c) == PIPE)
-#define is_rdin(c)   ((c) == RDIN)
-#define is_rdout(c)  ((c) == RDOUT)
-#define is_bg(c)     ((c) == BG)
+// Characters that end a word or need scan_word to tell what the word
+// holds. Most words have none of them until their end, and are found by
+// looking each character up here instead
+static const char not_plain[256] = {
+    ['\0'] = 1, [' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1,
+    ['\r'] = 1, [PIPE] = 1, [RDIN] = 1, [RDOUT] = 1, [BG] = 1, [SEMI] = 1,
+    [LPAREN] = 1, [RPAREN] = 1, [SQUOTE] = 1, [DQUOTE] = 1, [ESCAPE] = 1,
+    ['$'] = 1, ['*'] = 1, ['?'] = 1, ['['] = 1
+};
 
-#define is_spec(c)   (is_pipe(c) || is_rdin(c) || is_rdout(c) || is_bg(c))
-#define is_id(c)     (!is_spec(c) && !isspace(c))
+#define is_plain(c)  (!not_plain[(unsigned char) (c)])
+
+#define is_var_start(c) ((c)[0] == '$' && (is_name_start((c)[1]) || \
+                                           (c)[1] == '{' || \
+                                           is_special_param((c)[1])))
 
 
 // Parses a command line string given by the first parameter
@@ -25,6 +33,19 @@
 // which the shell can easily process
 int parse(char *line, parsed_line *pl) {
 
+    if (parse_raw(line, pl) < 0) {
+        return -1;
+    }
+    return expand_line(pl);
+
+}
+
+
+// Lexes a command line into the parse structure without expanding it.
+// Items with something to expand are left as written, with their flags
+// telling what
+int parse_raw(char *line, parsed_line *pl) {
+
     size_t item_count = 0;
     size_t pipe_count = 0;
 
@@ -38,6 +59,9 @@ int parse(char *line, parsed_line *pl) {
     // Initializes parse structure
     pl->rstdin     = NULL;
     pl->rstdout    = NULL;
+    pl->rstdin_flags  = 0;
+    pl->rstdout_flags = 0;
+    pl->rstdin_kind   = INPUT_FILE;
     pl->pipe_count = pipe_count;
     pl->background = 0;
     pl->state      = CMD_EXPECTED;
@@ -57,12 +81,23 @@ int parse(char *line, parsed_line *pl) {
 
     while (lex.has_next) {
         token = next_tok(&lex);
+        if (token == NULL) {
+            fprintf(stderr, "Unterminated quote\n");
+            return -1;
+        }
         first = token[0];
-        if (is_spec(first)) {
+        // A quoted word is never special, whatever it starts with
+        if (is_spec(first) && !lex.flags &&
+            (token[1] == '\0' || is_here(token))) {
             cmd = parse_spec(first, cmd, pl);
             if (cmd == NULL) {
                 return -1;
             }
+            if (is_rdin(first)) {
+                pl->rstdin_kind = token[1] == '\0' ? INPUT_FILE :
+                                  token[2] == '\0' ? INPUT_HEREDOC :
+                                                     INPUT_HERESTRING;
+            }
             if (is_bg(first) && !lex.has_next) {
                 pl->state = ACCEPTING;
             }
@@ -72,9 +107,11 @@ int parse(char *line, parsed_line *pl) {
         switch (pl->state) {
             case IN_EXPECTED:
                 pl->rstdin = token;
+                pl->rstdin_flags = lex.flags;
                 break;
             case OUT_EXPECTED:
                 pl->rstdout = token;
+                pl->rstdout_flags = lex.flags;
                 break;
             // & has to appear last on the command line
             case BG_SET:
@@ -83,6 +120,8 @@ int parse(char *line, parsed_line *pl) {
             case ACCEPTING: // Fallthrough
             case CMD_EXPECTED:
                 // Append to command item list
+                pl->item_buf->flags[cmd->items - pl->item_buf->start] =
+                    lex.flags;
                 *cmd->items++ = token;
                 cmd->length++;
                 break;
@@ -147,6 +186,8 @@ command *parse_spec(char spec, command *cmd, parsed_line *pl) {
             pl->state = BG_SET;
             break;
         default:
+            // Separators and parentheses belong to the script around a line
+            fprintf(stderr, "Unexpected %c\n", spec);
             return NULL;
 
     }
@@ -159,7 +200,8 @@ command *parse_spec(char spec, command *cmd, parsed_line *pl) {
 // and the pipeline depth of a command line
 void determine_size(char *line, size_t *item_count, size_t *pipe_count) {
 
-    char *c = line;
+    const char *c = line;
+    int flags;
     while (*c != '\0') {
 
         while (isspace(*c)) {
@@ -170,9 +212,13 @@ void determine_size(char *line, size_t *item_count, size_t *pipe_count) {
             *pipe_count += *c++ == PIPE;
         } else if (*c != '\0') {
             (*item_count)++;
-            while (is_id(*c) && *c != '\0') {
+            const char *start = c;
+            while (is_plain(*c)) {
                 c++;
             }
+            if (is_id(*c) && *c != '\0') {
+                c = scan_word(start, &flags);
+            }
         }
     }
 
@@ -182,16 +228,24 @@ void determine_size(char *line, size_t *item_count, size_t *pipe_count) {
 // Prepares lexer for use with function next_tok
 void init_lexer(line_lexer *lexer, char *line) {
 
+    while (isspace(*line)) {
+        line++;
+    }
+
     lexer->line        = line;
     lexer->pos         = line;
     lexer->saved_token = NULL;
     lexer->has_next    = *line != '\0';
+    lexer->flags       = 0;
 
 }
 
 
-// Returns the next token from the lexer, or NULL when done. Does not allocate
-// memory, but instead null terminates as appropriate
+// Returns the next token from the lexer, or NULL when done or if a quote is
+// not closed. Does not allocate memory, but instead null terminates as
+// appropriate. Quotes and escapes are removed by moving the rest of the
+// word back over them, unless the word also has something to expand. Then
+// it is returned as written, and its flags tell the expansion to handle them
 char *next_tok(line_lexer *lexer) {
 
     if (!lexer->has_next) {
@@ -204,46 +258,161 @@ char *next_tok(line_lexer *lexer) {
         char *ret = lexer->saved_token;
         lexer->saved_token = NULL;
         lexer->has_next = *lexer->pos != '\0';
+        lexer->flags = 0;
         return ret;
     }
 
+    // Cannot null terminate special token because first char of next
+    // token may be adjacent. Instead, return a constant
+    if (is_spec(*lexer->pos)) {
+        char *spec = (char *) spec_token(&lexer->pos);
+        while (isspace(*lexer->pos)) {
+            lexer->pos++;
+        }
+        lexer->has_next = *lexer->pos != '\0';
+        lexer->flags = 0;
+        return spec;
+    }
+
+    // Found start of id string. A word of plain characters ends at the
+    // first other one, and only a word with more in it has to be scanned
+    char *str_start = lexer->pos;
+    char *end = str_start;
+    while (is_plain(*end)) {
+        end++;
+    }
+    lexer->flags = 0;
+    if (is_id(*end) && *end != '\0') {
+        end = (char *) scan_word(str_start, &lexer->flags);
+    }
+    if (lexer->flags & WORD_OPEN) {
+        lexer->has_next = 0;
+        return NULL;
+    }
+
+    char *str_end = end;
+    if (lexer->flags == WORD_QUOTED) {
+        str_end = unquote(str_start, end);
+    }
+
+    lexer->pos = end;
+    if (is_spec(*end)) {
+        // Special token after id string: save it
+        lexer->saved_token = (char *) spec_token(&lexer->pos);
+    } else if (isspace(*end)) {
+        // Whitespace after id string: null terminate at first space
+        lexer->pos++;
+    }
+    *str_end = '\0';
+
     while (isspace(*lexer->pos)) {
         lexer->pos++;
     }
+    lexer->has_next = lexer->saved_token || *lexer->pos != '\0';
+
+    return str_start;
+
+}
 
-    while (*lexer->pos != '\0') {
-        // Cannot null terminate special token because first char of next
-        // token may be adjacent. Instead, return a constant
-        if (is_spec(*lexer->pos)) {
-            char *spec = (char *) get_spec(*lexer->pos++);
-            lexer->has_next = *lexer->pos != '\0';
-            return spec;
+
+// Finds the end of the word starting at c, which is where unquoted
+// whitespace or a special character begins, and sets flags to describe it
+const char *scan_word(const char *c, int *flags) {
+
+    char quote = '\0';
+    *flags = 0;
+
+    for (; *c != '\0'; ++c) {
+        if (quote == SQUOTE) {
+            quote = *c == SQUOTE ? '\0' : quote;
+            continue;
         }
-        // Found start of id string
-        char *str_start = lexer->pos;
-        while (is_id(*lexer->pos) && *lexer->pos != '\0') {
-            lexer->pos++;
+        if (quote == DQUOTE) {
+            if (*c == DQUOTE) {
+                quote = '\0';
+            } else if (*c == ESCAPE && c[1] != '\0') {
+                c++;
+            } else if (is_var_start(c)) {
+                *flags |= WORD_DYNAMIC;
+            }
+            continue;
         }
-        if (isspace(*lexer->pos)) {
-            // Whitespace after id string: null terminate at first space
-            *lexer->pos++ = '\0';
-        } else if (is_spec(*lexer->pos)) {
-            // Special token after id string: save it
-            lexer->saved_token = (char *) get_spec(*lexer->pos);
-            lexer->has_next = 1;
-            *lexer->pos++ = '\0';
+
+        if (!is_id(*c)) {
+            break;
+        }
+        if (*c == SQUOTE || *c == DQUOTE) {
+            quote = *c;
+            *flags |= WORD_QUOTED;
+        } else if (*c == ESCAPE) {
+            *flags |= WORD_QUOTED;
+            if (c[1] != '\0') {
+                c++;
+            }
+        } else if (is_var_start(c) || is_wild(*c)) {
+            *flags |= WORD_DYNAMIC;
         }
+    }
+
+    if (quote) {
+        *flags |= WORD_OPEN;
+    }
+    return c;
 
-        // Last token of the line
-        if (*lexer->pos == '\0' && lexer->saved_token == NULL) {
-            lexer->has_next = 0;
+}
+
+
+// Removes the quotes and escapes of the word between c and end by moving
+// the characters they protect back over them. Returns the new end
+char *unquote(char *c, char *end) {
+
+    char *to = c;
+    char quote = '\0';
+
+    for (; c < end; ++c) {
+        if (quote == SQUOTE) {
+            if (*c == SQUOTE) {
+                quote = '\0';
+            } else {
+                *to++ = *c;
+            }
+        } else if (quote == DQUOTE) {
+            if (*c == DQUOTE) {
+                quote = '\0';
+            } else if (*c == ESCAPE && c + 1 < end && is_dq_escapable(c[1])) {
+                *to++ = *++c;
+            } else {
+                *to++ = *c;
+            }
+        } else if (*c == SQUOTE || *c == DQUOTE) {
+            quote = *c;
+        } else if (*c == ESCAPE && c + 1 < end) {
+            *to++ = *++c;
+        } else {
+            *to++ = *c;
         }
+    }
 
-        return str_start;
+    return to;
 
-     }
+}
+
+
+// Returns the special token at pos, like get_spec, and moves pos past it.
+// A < may be the start of << or <<<
+const char *spec_token(char **pos) {
+
+    static const char HEREDOC_CONST[]    = { '<', '<', '\0' };
+    static const char HERESTRING_CONST[] = { '<', '<', '<', '\0' };
 
-    return NULL;
+    char *c = *pos;
+    if (is_rdin(c[0]) && is_rdin(c[1])) {
+        int string = is_rdin(c[2]);
+        *pos += 2 + string;
+        return string ? HERESTRING_CONST : HEREDOC_CONST;
+    }
+    (*pos)++;
+    return get_spec(*c);
 
 }
 
@@ -256,6 +425,9 @@ const char *get_spec(char c) {
     static const char RDIN_CONST[]  = { '<', '\0' };
     static const char RDOUT_CONST[] = { '>', '\0' };
     static const char BG_CONST[]    = { '&', '\0' };
+    static const char SEMI_CONST[]   = { ';', '\0' };
+    static const char LPAREN_CONST[] = { '(', '\0' };
+    static const char RPAREN_CONST[] = { ')', '\0' };
 
     switch (c) {
         case PIPE:
@@ -270,6 +442,15 @@ const char *get_spec(char c) {
         case BG:
             return BG_CONST;
             break;
+        case SEMI:
+            return SEMI_CONST;
+            break;
+        case LPAREN:
+            return LPAREN_CONST;
+            break;
+        case RPAREN:
+            return RPAREN_CONST;
+            break;
         default:
             return NULL;
     }
@@ -1,6 +1,48 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#define PIPE   ('|')
+#define RDOUT  ('>')
+#define RDIN   ('<')
+#define BG     ('&')
+#define SEMI   (';')
+#define LPAREN ('(')
+#define RPAREN (')')
+
+#define is_pipe(c)   ((c) == PIPE)
+#define is_rdin(c)   ((c) == RDIN)
+#define is_rdout(c)  ((c) == RDOUT)
+#define is_bg(c)     ((c) == BG)
+#define is_sep(c)    ((c) == SEMI || (c) == LPAREN || (c) == RPAREN)
+
+#define is_spec(c)   (is_pipe(c) || is_rdin(c) || is_rdout(c) || is_bg(c) || \
+                      is_sep(c))
+
+// << and <<< are lexed as single tokens
+#define is_here(t)   (is_rdin((t)[0]) && is_rdin((t)[1]))
+
+#define SQUOTE ('\'')
+#define DQUOTE ('"')
+#define ESCAPE ('\\')
+
+// Characters a backslash escapes inside double quotes
+#define is_dq_escapable(c) ((c) == '$' || (c) == DQUOTE || (c) == ESCAPE || \
+                            (c) == '`')
+
+// What scanning a word reveals about it
+#define WORD_QUOTED   1 // Has quotes or escapes to remove
+#define WORD_DYNAMIC  2 // Has variables or unquoted wildcards to expand
+#define WORD_OPEN     4 // Ends inside quotes
+
+// What stdin is redirected from
+enum input_kind {
+    INPUT_FILE,      // < file
+    INPUT_HEREDOC,   // <<word: the lines after this one, up to one that is
+                     // word. The target is the word while lexing, and the
+                     // text of those lines once the line has been compiled
+    INPUT_HERESTRING // <<< word: the word and a newline
+};
+
 // The commands in a pipeline are structured as a linked list
 typedef struct c {
     // The items of a single command is a list of strings ending with NULL
@@ -12,6 +54,7 @@ typedef struct c {
 
 typedef struct cb command_buffer;
 typedef struct ib item_buffer;
+typedef struct sb string_buffer;
 
 // The different states a parse structure can be in while parsing
 enum parse_state {
@@ -27,11 +70,16 @@ typedef struct pl {
     command *cmd;
     char *rstdin;
     char *rstdout;
+    int rstdin_flags;  // Word flags of the redirection targets
+    int rstdout_flags;
+    enum input_kind rstdin_kind;
     int background;
     size_t pipe_count;
     enum parse_state state;
     command_buffer *cmd_buf;
     item_buffer *item_buf;
+    item_buffer *exp_buf;
+    string_buffer *str_buf;
 } parsed_line;
 
 // A simple lexer structure used to feed tokens to the parsing functions
@@ -40,14 +88,19 @@ typedef struct ll {
     char *pos;
     char *saved_token;
     int has_next;
+    int flags; // Word flags of the last returned token
 } line_lexer;
 
 
 int parse(char *line, parsed_line *pl);
+int parse_raw(char *line, parsed_line *pl);
 void determine_size(char *line, size_t *item_count, size_t *pipe_count);
 command *parse_spec(char spec, command *cmd, parsed_line *pl);
 void init_lexer(line_lexer *lexer, char *line);
 char *next_tok(line_lexer *lexer);
+const char *scan_word(const char *c, int *flags);
+char *unquote(char *c, char *end);
+const char *spec_token(char **pos);
 const char *get_spec(char c);
 
 #endif
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include "parser.h"
+#include "pipestat.h"
+
+static void step(pipe_meter *m);
+static void finish(pipe_meter *m);
+static double now();
+
+
+// A command line may start with "pipestat command", in which case the
+// pipes between its stages are metered. If so, advances the first command
+// past it and returns 1, and otherwise returns 0
+int strip_pipestat(command *first) {
+
+    if (first->items[0] == NULL || strcmp(first->items[0], PIPESTAT_WORD) ||
+        first->items[1] == NULL) {
+        return 0;
+    }
+    first->items++;
+    first->length--;
+    return 1;
+
+}
+
+
+// Moves data through the pipes of a metered job until each stage but the
+// last has closed its output, or the stage after it has gone away
+void relay_pipes(pipe_meter *meters, size_t count) {
+
+    struct pollfd fds[count];
+    size_t active = count;
+    double start = now();
+    double last = start;
+
+    for (size_t i = 0; i < count; ++i) {
+        fcntl(meters[i].in, F_SETFL, O_NONBLOCK);
+        fcntl(meters[i].out, F_SETFL, O_NONBLOCK);
+    }
+
+    while (active > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            pipe_meter *m = &meters[i];
+            fds[i].fd = m->done ? -1 : m->pending ? m->out : m->in;
+            fds[i].events = m->pending ? POLLOUT : POLLIN;
+        }
+        int res = poll(fds, count, -1);
+
+        // Time spent in poll is put on whatever each pipe waited for
+        double t = now();
+        for (size_t i = 0; i < count; ++i) {
+            if (!meters[i].done) {
+                *(meters[i].pending ? &meters[i].full : &meters[i].empty) +=
+                    t - last;
+            }
+        }
+        last = t;
+        if (res < 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (fds[i].fd != -1 && fds[i].revents) {
+                step(&meters[i]);
+                if (meters[i].done) {
+                    meters[i].time = t - start;
+                    active--;
+                }
+            }
+        }
+    }
+
+}
+
+
+// Prints to stderr what went through each pipe of a metered job
+void print_pipestat(const pipe_meter *meters, size_t count, command *first) {
+
+    for (size_t i = 0; i < count; ++i) {
+        const pipe_meter *m = &meters[i];
+        const char *from = first[i].items[0];
+        const char *to = first[i + 1].items[0];
+        double time = m->time > 0 ? m->time : 1e-9;
+
+        fprintf(stderr, "pipestat: %zu %s | %s: %llu bytes, %llu lines"
+                " in %.3f s (%.2f MB/s, %.0f lines/s),"
+                " full %.3f s, empty %.3f s\n",
+                i + 1, from ? from : "", to ? to : "", m->bytes, m->records,
+                m->time, m->bytes / time / 1e6, m->records / time,
+                m->full, m->empty);
+    }
+
+}
+
+
+// Reads from the earlier stage if nothing is pending, and writes what is
+// pending to the later stage
+static void step(pipe_meter *m) {
+
+    if (m->pending == 0) {
+        ssize_t n = read(m->in, m->buf, sizeof(m->buf));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            finish(m);
+            return;
+        }
+        if (n < 0) {
+            return;
+        }
+        m->pending = n;
+        m->offset = 0;
+        m->bytes += n;
+        const char *end = m->buf + n;
+        for (const char *c = m->buf; (c = memchr(c, '\n', end - c)); ++c) {
+            m->records++;
+        }
+    }
+
+    ssize_t n = write(m->out, m->buf + m->offset, m->pending);
+    if (n > 0) {
+        m->offset += n;
+        m->pending -= n;
+    } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        // The later stage is gone. Closing in makes the earlier one
+        // see that too, as it would without the shell in between
+        finish(m);
+    }
+
+}
+
+
+static void finish(pipe_meter *m) {
+
+    close(m->in);
+    close(m->out);
+    m->pending = 0;
+    m->done = 1;
+
+}
+
+
+static double now() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
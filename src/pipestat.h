@@ -0,0 +1,33 @@
+#ifndef PIPESTAT_H
+#define PIPESTAT_H
+
+#include <stddef.h>
+
+#define PIPESTAT_WORD    "pipestat" // Leading word that meters a job
+#define PIPESTAT_BUF     (1 << 16)  // Bytes moved at a time
+
+// The shell's part of a pipe between two stages of a metered job.
+// The earlier stage writes to one pipe and the later reads from another,
+// and the shell moves the data across, counting it. It waits on out while
+// the later stage is not keeping up, and on in while the earlier is not
+typedef struct pm {
+    int in;              // Read end of the pipe the earlier stage writes to
+    int out;             // Write end of the pipe the later stage reads from
+    int done;
+    size_t pending;      // Bytes read but not yet written
+    size_t offset;
+    unsigned long long bytes;
+    unsigned long long records; // Lines
+    double full;         // Seconds spent waiting to write
+    double empty;        // Seconds spent waiting for something to read
+    double time;         // Seconds until the earlier stage was done
+    char buf[PIPESTAT_BUF];
+} pipe_meter;
+
+typedef struct c command;
+
+int strip_pipestat(command *first);
+void relay_pipes(pipe_meter *meters, size_t count);
+void print_pipestat(const pipe_meter *meters, size_t count, command *first);
+
+#endif
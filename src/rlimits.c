@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "rlimits.h"
+#include "parser.h"
+
+// The limits ulimit knows about, in the order of the bits in job_limits.set.
+// Values on the command line are given in units of the resource's scale.
+static const struct {
+    char opt;
+    int resource;
+    rlim_t scale;
+    const char *desc;
+} limit_table[JOB_LIMIT_COUNT] = {
+    { 'c', RLIMIT_CORE,   1024, "core file size (KiB)" },
+    { 'd', RLIMIT_DATA,   1024, "data segment size (KiB)" },
+    { 'f', RLIMIT_FSIZE,  1024, "file size (KiB)" },
+    { 'n', RLIMIT_NOFILE,    1, "open files" },
+    { 's', RLIMIT_STACK,  1024, "stack size (KiB)" },
+    { 't', RLIMIT_CPU,       1, "cpu time (seconds)" },
+    { 'u', RLIMIT_NPROC,     1, "processes" },
+    { 'v', RLIMIT_AS,     1024, "virtual memory (KiB)" }
+};
+
+
+static int find_limit(const char *opt);
+static void print_value(const job_limits *jl, int i);
+
+
+// Limits set with the ulimit builtin, applied to every job
+job_limits *shell_limits() {
+
+    static job_limits limits;
+    return &limits;
+
+}
+
+
+// Reads "-x value" option pairs from the start of a NULL terminated item
+// list into jl. Returns the number of items consumed, or -1 on bad input
+int parse_limits(char **items, job_limits *jl) {
+
+    int consumed = 0;
+
+    while (items[0] && items[0][0] == '-') {
+        int i = find_limit(items[0]);
+        if (i < 0) {
+            return -1;
+        }
+
+        char *value = items[1];
+        if (value == NULL) {
+            fprintf(stderr, "ulimit: %s expects a value\n", items[0]);
+            return -1;
+        }
+
+        rlim_t lim;
+        if (!strcmp(value, "unlimited")) {
+            lim = RLIM_INFINITY;
+        } else {
+            // strtoull would take -5 as a huge limit
+            char *end;
+            errno = 0;
+            unsigned long long n = strtoull(value, &end, 10);
+            if (!isdigit((unsigned char) value[0]) || errno || *end != '\0' ||
+                n > RLIM_INFINITY / limit_table[i].scale) {
+                fprintf(stderr, "ulimit: bad limit %s\n", value);
+                return -1;
+            }
+            lim = n * limit_table[i].scale;
+        }
+
+        // Both soft and hard, so the job cannot raise it again
+        jl->lim[i].rlim_cur = lim;
+        jl->lim[i].rlim_max = lim;
+        jl->set |= 1u << i;
+
+        items += 2;
+        consumed += 2;
+    }
+
+    return consumed;
+
+}
+
+
+// Returns the index in limit_table of an option such as "-n",
+// or -1 if there is no such limit
+static int find_limit(const char *opt) {
+
+    if (opt[0] == '-' && opt[1] != '\0' && opt[2] == '\0') {
+        for (int i = 0; i < JOB_LIMIT_COUNT; ++i) {
+            if (limit_table[i].opt == opt[1]) {
+                return i;
+            }
+        }
+    }
+    fprintf(stderr, "ulimit: bad option %s\n", opt);
+    return -1;
+
+}
+
+
+// A command line may start with "ulimit [-x value]... command", in which
+// case the limits only apply to that job. If so, merges them into jl,
+// advances the first command past them and returns 1. Returns 0 if the
+// line does not have that form, and -1 if the limits are malformed
+int strip_inline_limits(command *first, job_limits *jl) {
+
+    // "ulimit" and "ulimit -x" are the builtin printing limits
+    if (strcmp(first->items[0], "ulimit") || first->items[1] == NULL ||
+        first->items[2] == NULL) {
+        return 0;
+    }
+
+    job_limits inline_limits = *jl;
+    int consumed = parse_limits(first->items + 1, &inline_limits);
+    if (consumed < 0) {
+        return -1;
+    }
+
+    // Only options: the ulimit builtin itself
+    if (first->items[consumed + 1] == NULL) {
+        return 0;
+    }
+
+    *jl = inline_limits;
+    first->items  += consumed + 1;
+    first->length -= consumed + 1;
+    return 1;
+
+}
+
+
+// Sets the limits for the calling process. Meant to be called in a forked
+// child before it starts the commands of a job, so every stage inherits them
+int apply_limits(const job_limits *jl) {
+
+    for (int i = 0; i < JOB_LIMIT_COUNT; ++i) {
+        if (!(jl->set & (1u << i))) {
+            continue;
+        }
+
+        struct rlimit lim = jl->lim[i];
+        struct rlimit curr;
+        getrlimit(limit_table[i].resource, &curr);
+        // An unprivileged process can only lower its hard limit
+        if (lim.rlim_max > curr.rlim_max) {
+            lim.rlim_max = curr.rlim_max;
+            if (lim.rlim_cur > lim.rlim_max) {
+                lim.rlim_cur = lim.rlim_max;
+            }
+        }
+
+        if (setrlimit(limit_table[i].resource, &lim) != 0) {
+            fprintf(stderr, "ulimit: could not set %s\n", limit_table[i].desc);
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+
+// Prints the limits jobs will run with: those set in jl,
+// and otherwise the ones the shell itself has
+void print_limits(const job_limits *jl) {
+
+    for (int i = 0; i < JOB_LIMIT_COUNT; ++i) {
+        printf("-%c %-24s ", limit_table[i].opt, limit_table[i].desc);
+        print_value(jl, i);
+    }
+
+}
+
+
+// Prints the one limit given by an option such as "-n", as print_limits
+// does. Returns -1 if there is no such limit
+int print_limit(const job_limits *jl, const char *opt) {
+
+    int i = find_limit(opt);
+    if (i < 0) {
+        return -1;
+    }
+    print_value(jl, i);
+    return 0;
+
+}
+
+
+static void print_value(const job_limits *jl, int i) {
+
+    rlim_t lim;
+    if (jl->set & (1u << i)) {
+        lim = jl->lim[i].rlim_cur;
+    } else {
+        struct rlimit curr;
+        getrlimit(limit_table[i].resource, &curr);
+        lim = curr.rlim_cur;
+    }
+
+    if (lim == RLIM_INFINITY) {
+        printf("unlimited\n");
+    } else {
+        printf("%llu\n", (unsigned long long) (lim / limit_table[i].scale));
+    }
+
+}
@@ -0,0 +1,23 @@
+#ifndef RLIMITS_H
+#define RLIMITS_H
+
+#include <sys/resource.h>
+
+#define JOB_LIMIT_COUNT 8
+
+// Resource limits given to the processes of a job
+typedef struct jl {
+    struct rlimit lim[JOB_LIMIT_COUNT];
+    unsigned int set; // Bit i is set if lim[i] should be applied
+} job_limits;
+
+typedef struct c command;
+
+job_limits *shell_limits();
+int parse_limits(char **items, job_limits *jl);
+int strip_inline_limits(command *first, job_limits *jl);
+int apply_limits(const job_limits *jl);
+void print_limits(const job_limits *jl);
+int print_limit(const job_limits *jl, const char *opt);
+
+#endif
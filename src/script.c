@@ -0,0 +1,1281 @@
+#define _GNU_SOURCE // pipe2
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "parser.h"
+#include "buffers.h"
+#include "expand.h"
+#include "stored.h"
+#include "funcs.h"
+#include "exec.h"
+#include "vars.h"
+#include "builtins.h"
+#include "linecache.h"
+#include "script.h"
+
+#define NEWLINE ('\n')
+
+// Words that start or end compound commands where a command could start
+static const char *const reserved[] = {
+    "if", "then", "elif", "else", "fi",
+    "while", "until", "for", "do", "done",
+    "{", "}", NULL
+};
+
+static const char *const then_word[] = { "then", NULL };
+static const char *const if_end[]    = { "elif", "else", "fi", NULL };
+static const char *const fi_word[]   = { "fi", NULL };
+static const char *const do_word[]   = { "do", NULL };
+static const char *const done_word[] = { "done", NULL };
+static const char *const brace_end[] = { "}", NULL };
+static const char *const paren_end[] = { ")", NULL };
+
+static int call_depth;     // Function calls being run
+static int returning;      // Set by return until the function is left
+static int return_status;
+static int loop_depth;     // Loops being run in the current function
+static int breaking;       // Loops left to break out of
+static int continuing;     // Set when the innermost loop left should go on
+static int incomplete;     // Compiling ran out of text inside a command
+static volatile sig_atomic_t interrupted; // Set on Ctrl-C until the next line
+static void (*before_run)(void); // Told when a line read is complete
+
+static int run_node(node *n, parsed_line *pl);
+static int run_if(node *n, parsed_line *pl);
+static int run_while(node *n, parsed_line *pl);
+static int run_for(node *n, parsed_line *pl);
+static int stop_loop();
+static int run_group(node *n, parsed_line *pl);
+static int run_pipe(node *n, parsed_line *pl);
+static int run_stages(node *n, parsed_line *pl);
+static void run_in_child(node *list, parsed_line *pl);
+static int redirect_group(node *n, parsed_line *pl, int saved[2]);
+static int wait_status(pid_t pid);
+static node *compile_list(char **pos, const char *const *end_words,
+                          int *matched, parsed_line *pl);
+static node *compile_command(char **pos, parsed_line *pl);
+static node *compile_funcdef(char **pos, char *name_end, parsed_line *pl);
+static node *compile_if(char **pos, parsed_line *pl);
+static node *compile_while(char **pos, int until, parsed_line *pl);
+static node *compile_for(char **pos, parsed_line *pl);
+static node *compile_stages(char **pos, parsed_line *pl);
+static node *compile_group(char **pos, parsed_line *pl);
+static int compile_redirects(char **pos, node *n);
+static node *compile_pipeline(char **pos, int stage, parsed_line *pl);
+static int take_heredoc(char *end, char next, parsed_line *pl,
+                        char **cut, char **rest);
+static int end_command(char **pos, const char *const *end_words);
+static int run_pipeline_line(int loaded, parsed_line *pl);
+static int run_compiled(node *list, parsed_line *pl);
+static int lex_line(char *text, parsed_line *pl);
+static char *pipeline_end(char *c);
+static char *stage_end(char *c);
+static int has_group_stage(char *c);
+static char *funcdef(char *c, char **name_end);
+static char *reserved_word(char *c, const char *word);
+static char *any_word(char *c, const char *const *words, int *matched);
+static char *skip_space(char *c);
+static char *skip_blank(char *c);
+static node *new_node(enum node_type type);
+
+
+// Runs a command line. A line that is a single pipeline is lexed, expanded
+// and run straight from the line buffer. Anything else is compiled as a
+// whole first, so a syntax error anywhere keeps all of it from running.
+// Either way the result is cached, and the same line run again is only
+// expanded. Returns the status of the last command, -1 if the line is not
+// valid, or LINE_INCOMPLETE if a compound command goes on past the end of it
+int run_line(char *line, parsed_line *pl) {
+
+    interrupted = 0;
+    size_t len = strlen(line);
+    cache_entry *cached = find_cached_line(line, len);
+    if (cached && before_run) {
+        before_run();
+    }
+    if (cached && cached->line) {
+        return run_pipeline_line(load_line(cached->line, pl), pl);
+    }
+    if (cached) {
+        return run_compiled(retain_node(cached->list), pl);
+    }
+    cache_entry *entry = new_cache_entry(line, len);
+
+    char *end = pipeline_end(line);
+    char *name_end;
+    int matched;
+    if (end == NULL) {
+        free(entry);
+        if (before_run) {
+            before_run();
+        }
+        return -1;
+    }
+
+    if (*skip_space(end) == '\0' && !funcdef(line, &name_end) &&
+        !any_word(line, reserved, &matched)) {
+        int res = lex_line(line, pl);
+        // The lines of a here-document have not been read yet
+        if (res == 0 && pl->rstdin_kind == INPUT_HEREDOC) {
+            free(entry);
+            return LINE_INCOMPLETE;
+        }
+        if (before_run) {
+            before_run();
+        }
+        if (res == 0 && entry && (entry->line = store_line(pl))) {
+            cache_line(entry);
+        } else {
+            free(entry);
+        }
+        return run_pipeline_line(res, pl);
+    }
+
+    char *pos = line;
+    incomplete = 0;
+    node *list = compile_list(&pos, NULL, NULL, pl);
+    if (list == NULL && incomplete) {
+        free(entry);
+        return LINE_INCOMPLETE;
+    }
+    if (before_run) {
+        before_run();
+    }
+    if (list == NULL) {
+        free(entry);
+        return -1;
+    }
+    if (entry) {
+        entry->list = retain_node(list);
+        cache_line(entry);
+    }
+    return run_compiled(list, pl);
+
+}
+
+
+// Makes the commands being run stop after the one running, as Ctrl-C does.
+// Only sets a flag, so it can be called from a signal handler
+void interrupt_commands() {
+
+    interrupted = 1;
+
+}
+
+
+// Makes run_line call hook once a line is complete, before any of it runs,
+// so the line can be kept even if running it makes the shell exit
+void set_run_hook(void (*hook)(void)) {
+
+    before_run = hook;
+
+}
+
+
+// Expands and runs a single pipeline once it has been lexed or loaded,
+// unless that failed
+static int run_pipeline_line(int loaded, parsed_line *pl) {
+
+    if (loaded < 0 || expand_line(pl) < 0) {
+        return -1;
+    }
+    int status = interpret_command_line(pl);
+    set_last_status(status);
+    return status;
+
+}
+
+
+// Runs a compiled line and lets go of it
+static int run_compiled(node *list, parsed_line *pl) {
+
+    int status = run_list(list, pl);
+    release_node(list);
+    return status;
+
+}
+
+
+// Runs compiled commands one after the other, until they are done, a
+// return, break or continue leaves them, or they are interrupted.
+// Returns the status of the last one
+int run_list(node *list, parsed_line *pl) {
+
+    int status = 0;
+    for (node *n = list; n; n = n->next) {
+        status = run_node(n, pl);
+        set_last_status(status);
+        if (returning || breaking || continuing || interrupted) {
+            break;
+        }
+    }
+    return returning ? return_status : status;
+
+}
+
+
+// Runs a function in the shell process, with args as its positional
+// parameters. Returns the status of its last command, or the one given
+// to return
+int call_function(node *body, char **args, parsed_line *pl) {
+
+    if (call_depth >= FUNC_DEPTH_MAX) {
+        fprintf(stderr, "Function calls nested too deeply\n");
+        return 1;
+    }
+
+    // The arguments are in buffers the body reuses
+    param_list params;
+    params.args = copy_items(args, &params.count);
+    if (params.args == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    param_list outer = set_params(params);
+
+    // Loops around the call cannot be left from inside it
+    int outer_loops = loop_depth;
+    loop_depth = 0;
+
+    // The body stays even if the function is defined again while it runs
+    retain_node(body);
+    call_depth++;
+    int status = run_list(body, pl);
+    call_depth--;
+    returning = 0;
+    release_node(body);
+
+    loop_depth = outer_loops;
+    set_params(outer);
+    free(params.args);
+    return status;
+
+}
+
+
+// Makes the function being run stop with the given status once the
+// current command is done. Only the low 8 bits are kept, as for an exit
+// status, so a negative one is not taken for a parse error.
+// Returns -1 if no function is being run
+int return_from_function(int status) {
+
+    if (call_depth == 0) {
+        return -1;
+    }
+    returning = 1;
+    return_status = status & 255;
+    return 0;
+
+}
+
+
+// Leaves count of the loops being run, for break, or all but the last of
+// them, which goes on with its next iteration, for continue. A count past
+// the outermost loop means all of them. Returns -1 if no loop is being run
+int leave_loops(int count, int next_iteration) {
+
+    if (loop_depth == 0) {
+        return -1;
+    }
+    if (count > loop_depth) {
+        count = loop_depth;
+    }
+    breaking = count - next_iteration;
+    continuing = next_iteration;
+    return 0;
+
+}
+
+
+node *retain_node(node *n) {
+
+    n->refs++;
+    return n;
+
+}
+
+
+// Lets go of a list of nodes, which is freed with everything
+// below it when nothing else holds it
+void release_node(node *n) {
+
+    if (n == NULL || --n->refs > 0) {
+        return;
+    }
+    while (n) {
+        node *next = n->next;
+        free(n->line);
+        free(n->name);
+        free(n->rstdin);
+        free(n->rstdout);
+        release_node(n->cond);
+        release_node(n->body);
+        release_node(n->alt);
+        free(n);
+        n = next;
+    }
+
+}
+
+
+static int run_node(node *n, parsed_line *pl) {
+
+    switch (n->type) {
+        case NODE_PIPELINE:
+            if (load_line(n->line, pl) < 0 || expand_line(pl) < 0) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            return interpret_command_line(pl);
+        case NODE_FUNCDEF:
+            if (define_function(n->name, n->body) < 0) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            return 0;
+        case NODE_IF:
+            return run_if(n, pl);
+        case NODE_WHILE:
+            return run_while(n, pl);
+        case NODE_FOR:
+            return run_for(n, pl);
+        case NODE_GROUP:
+        case NODE_SUBSHELL:
+            return run_group(n, pl);
+        case NODE_PIPE:
+            return run_pipe(n, pl);
+    }
+    return 0;
+
+}
+
+
+static int run_if(node *n, parsed_line *pl) {
+
+    int status = run_list(n->cond, pl);
+    if (returning || breaking || continuing || interrupted) {
+        return status;
+    }
+    if (status == 0) {
+        return run_list(n->body, pl);
+    }
+    return n->alt ? run_list(n->alt, pl) : 0;
+
+}
+
+
+static int run_while(node *n, parsed_line *pl) {
+
+    int status = 0;
+    loop_depth++;
+
+    while (1) {
+        int cond = run_list(n->cond, pl);
+        if (stop_loop() || (cond == 0) == n->until) {
+            break;
+        }
+        status = run_list(n->body, pl);
+        if (stop_loop()) {
+            break;
+        }
+    }
+
+    loop_depth--;
+    return returning ? return_status : status;
+
+}
+
+
+// Runs the body of a for loop once for each word its list expands to,
+// which is done once, before the first iteration
+static int run_for(node *n, parsed_line *pl) {
+
+    static char *no_words[] = { NULL };
+    char **words;
+
+    if (n->line == NULL) {
+        // Without a list, the loop goes through the arguments
+        const param_list *params = get_params();
+        words = copy_items(params->count ? params->args : no_words, NULL);
+    } else if (load_line(n->line, pl) < 0 || expand_line(pl) < 0) {
+        words = NULL;
+    } else {
+        words = copy_items(pl->cmd->items, NULL);
+    }
+    if (words == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int status = 0;
+    size_t name_len = strlen(n->name);
+    loop_depth++;
+
+    for (char **word = words; *word; ++word) {
+        if (set_var(n->name, name_len, *word, 0) < 0) {
+            fprintf(stderr, "Out of memory\n");
+            status = 1;
+            break;
+        }
+        var_changed(n->name, name_len);
+        status = run_list(n->body, pl);
+        if (stop_loop()) {
+            break;
+        }
+    }
+
+    loop_depth--;
+    free(words);
+    return returning ? return_status : status;
+
+}
+
+
+// Checks what break, continue or return asks of the loop being run after
+// its condition or body, and whether it was interrupted.
+// Returns 1 if it should stop
+static int stop_loop() {
+
+    if (returning || interrupted) {
+        return 1;
+    }
+    if (breaking) {
+        breaking--;
+        return 1;
+    }
+    continuing = 0;
+    return 0;
+
+}
+
+
+// Runs a { } group in the shell, or a ( ) group in a child process, with
+// the redirections of the group applied to all of its commands
+static int run_group(node *n, parsed_line *pl) {
+
+    if (n->type == NODE_GROUP) {
+        int saved[2];
+        if (redirect_group(n, pl, saved) < 0) {
+            return 1;
+        }
+        int status = run_list(n->body, pl);
+        restore_shell(saved);
+        return status;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        fprintf(stderr, "Fork error\n");
+        return 1;
+    } else if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        if (redirect_group(n, pl, NULL) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        run_in_child(n->body, pl);
+    }
+    return wait_status(pid);
+
+}
+
+
+// Runs the stages of a pipe that has groups, each in a child process of
+// its own. One in the background is left to a grandchild, so the shell
+// never has to wait for it
+static int run_pipe(node *n, parsed_line *pl) {
+
+    if (!n->background) {
+        return run_stages(n, pl);
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        fprintf(stderr, "Fork error\n");
+        return 1;
+    } else if (pid == 0) {
+        if (fork() != 0) {
+            exit(0);
+        }
+        setpgid(0, 0); // Makes it not receive SIGINT from Ctrl-C
+        exit(run_stages(n, pl));
+    }
+    waitpid(pid, NULL, 0);
+    return 0;
+
+}
+
+
+// Starts a child for each stage, reading from the stage before it and
+// writing to the one after, and waits for all of them.
+// Returns the status of the last one
+static int run_stages(node *n, parsed_line *pl) {
+
+    size_t count = 0;
+    for (node *s = n->body; s; s = s->next) {
+        count++;
+    }
+    pid_t *pids = malloc(count * sizeof(pid_t));
+    if (pids == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    fflush(stdout);
+    size_t started = 0;
+    int in = 0;
+    for (node *s = n->body; s; s = s->next) {
+        int p[2] = { -1, 1 };
+        if (s->next && pipe2(p, O_CLOEXEC) == -1) {
+            fprintf(stderr, "Unable to create pipe\n");
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (in != 0) {
+                dup2(in, 0);
+                close(in);
+            }
+            if (p[1] != 1) {
+                dup2(p[1], 1);
+                close(p[1]);
+                close(p[0]);
+            }
+            signal(SIGINT, SIG_DFL);
+            if (s->type == NODE_PIPELINE) {
+                exec_in_place();
+                exit(run_node(s, pl));
+            }
+            if (redirect_group(s, pl, NULL) < 0) {
+                exit(EXIT_FAILURE);
+            }
+            run_in_child(s->body, pl);
+        }
+        if (in != 0) {
+            close(in);
+        }
+        if (p[1] != 1) {
+            close(p[1]);
+        }
+        in = p[0];
+        if (pid == -1) {
+            fprintf(stderr, "Fork error\n");
+            break;
+        }
+        pids[started++] = pid;
+    }
+    if (in != 0 && in != -1) {
+        close(in);
+    }
+
+    int status = 1;
+    for (size_t i = 0; i < started; ++i) {
+        status = wait_status(pids[i]);
+    }
+    if (started < count) {
+        status = 1;
+    }
+    free(pids);
+    return status;
+
+}
+
+
+// Runs a list in a child process and exits with its status. A last command
+// that runs no more than one external command replaces the child with it
+static void run_in_child(node *list, parsed_line *pl) {
+
+    int status = 0;
+    for (node *n = list; n; n = n->next) {
+        if (n->next == NULL && n->type == NODE_PIPELINE) {
+            exec_in_place();
+        }
+        status = run_node(n, pl);
+        set_last_status(status);
+        if (returning || breaking || continuing || interrupted) {
+            break;
+        }
+    }
+    exit(returning ? return_status : status);
+
+}
+
+
+// Applies the redirections of a group to the shell, or to the child
+// running it if saved is NULL
+static int redirect_group(node *n, parsed_line *pl, int saved[2]) {
+
+    char *in = n->rstdin;
+    char *out = n->rstdout;
+    if ((in && (in = expand_single(pl, in)) == NULL) ||
+        (out && (out = expand_single(pl, out)) == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    return redirect_shell(in, n->rstdin_kind, out, saved);
+
+}
+
+
+static int wait_status(pid_t pid) {
+
+    int res;
+    if (waitpid(pid, &res, 0) == -1) {
+        return 1;
+    }
+    return WIFSIGNALED(res) ? 128 + WTERMSIG(res) : WEXITSTATUS(res);
+
+}
+
+
+// Compiles the commands from pos up to the end of the text, or up to one
+// of the reserved words in end_words if given. The index of the one found
+// is put in matched. Moves pos past them and returns the first node, or
+// prints what is wrong and returns NULL. Running out of text before an end
+// word is not an error to print, since more lines may follow
+static node *compile_list(char **pos, const char *const *end_words,
+                          int *matched, parsed_line *pl) {
+
+    node *list = NULL;
+    node **tail = &list;
+    int found = 0;
+
+    while (1) {
+        char *c = skip_space(*pos);
+        char *after = end_words ? any_word(c, end_words, &found) : NULL;
+        if (after || *c == '\0') {
+            if (end_words && !after) {
+                incomplete = 1;
+            } else if (list == NULL) {
+                fprintf(stderr, "Unexpected %s\n",
+                        after ? end_words[found] : "end");
+            } else {
+                if (matched != NULL) {
+                    *matched = found;
+                }
+                *pos = after ? after : c;
+                return list;
+            }
+            release_node(list);
+            return NULL;
+        }
+
+        *pos = c;
+        node *n = compile_command(pos, pl);
+        if (n == NULL) {
+            release_node(list);
+            return NULL;
+        }
+        *tail = n;
+        tail = &n->next;
+        if (end_command(pos, end_words) < 0) {
+            release_node(list);
+            return NULL;
+        }
+    }
+
+}
+
+
+// Compiles the command at pos, which is a pipeline, a function definition,
+// a compound command or a group, and moves pos past it.
+// Returns NULL on a syntax error
+static node *compile_command(char **pos, parsed_line *pl) {
+
+    char *c = *pos;
+    char *name_end;
+    int word;
+
+    if (*c == LPAREN || reserved_word(c, "{")) {
+        return compile_stages(pos, pl);
+    }
+    if (is_sep(*c)) {
+        fprintf(stderr, "Unexpected %c\n", *c);
+        return NULL;
+    }
+    if (funcdef(c, &name_end)) {
+        return compile_funcdef(pos, name_end, pl);
+    }
+
+    char *after = any_word(c, reserved, &word);
+    if (after == NULL) {
+        return has_group_stage(c) ? compile_stages(pos, pl) :
+               compile_pipeline(pos, 0, pl);
+    }
+    *pos = after;
+    if (!strcmp(reserved[word], "if")) {
+        return compile_if(pos, pl);
+    } else if (!strcmp(reserved[word], "while")) {
+        return compile_while(pos, 0, pl);
+    } else if (!strcmp(reserved[word], "until")) {
+        return compile_while(pos, 1, pl);
+    } else if (!strcmp(reserved[word], "for")) {
+        return compile_for(pos, pl);
+    }
+
+    fprintf(stderr, "Unexpected %s\n", reserved[word]);
+    return NULL;
+
+}
+
+
+// Compiles name() { list; }, starting at the name
+static node *compile_funcdef(char **pos, char *name_end, parsed_line *pl) {
+
+    char *name = *pos;
+    char *body = reserved_word(skip_space(funcdef(name, &name_end)), "{");
+    if (body == NULL) {
+        fprintf(stderr, "Expected { after %.*s()\n",
+                (int) (name_end - name), name);
+        return NULL;
+    }
+
+    node *n = new_node(NODE_FUNCDEF);
+    if (n == NULL || (n->name = strndup(name, name_end - name)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        release_node(n);
+        return NULL;
+    }
+    *pos = body;
+    n->body = compile_list(pos, brace_end, NULL, pl);
+    if (n->body == NULL) {
+        release_node(n);
+        return NULL;
+    }
+    return n;
+
+}
+
+
+// Compiles the rest of an if, or of an elif which becomes an if of its own
+static node *compile_if(char **pos, parsed_line *pl) {
+
+    node *n = new_node(NODE_IF);
+    int matched = 0;
+    if (n == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    n->cond = compile_list(pos, then_word, &matched, pl);
+    if (n->cond != NULL) {
+        n->body = compile_list(pos, if_end, &matched, pl);
+    }
+    if (n->body == NULL) {
+        release_node(n);
+        return NULL;
+    }
+
+    if (!strcmp(if_end[matched], "elif")) {
+        n->alt = compile_if(pos, pl);
+    } else if (!strcmp(if_end[matched], "else")) {
+        n->alt = compile_list(pos, fi_word, &matched, pl);
+    } else {
+        return n;
+    }
+    if (n->alt == NULL) {
+        release_node(n);
+        return NULL;
+    }
+    return n;
+
+}
+
+
+static node *compile_while(char **pos, int until, parsed_line *pl) {
+
+    node *n = new_node(NODE_WHILE);
+    if (n == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    n->until = until;
+
+    n->cond = compile_list(pos, do_word, NULL, pl);
+    if (n->cond != NULL) {
+        n->body = compile_list(pos, done_word, NULL, pl);
+    }
+    if (n->body == NULL) {
+        release_node(n);
+        return NULL;
+    }
+    return n;
+
+}
+
+
+// Compiles for name [in word...]; do list; done. The words are lexed and
+// stored like a command, to be expanded when the loop starts
+static node *compile_for(char **pos, parsed_line *pl) {
+
+    char *name = skip_blank(*pos);
+    char *name_end = name;
+    while (is_name_char(*name_end)) {
+        name_end++;
+    }
+    if (!is_name_start(*name) || name_end == name) {
+        fprintf(stderr, "for: bad name %.*s\n",
+                (int) strcspn(name, " \t\n;"), name);
+        return NULL;
+    }
+
+    node *n = new_node(NODE_FOR);
+    if (n == NULL || (n->name = strndup(name, name_end - name)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        release_node(n);
+        return NULL;
+    }
+
+    char *c = skip_blank(name_end);
+    char *words = reserved_word(c, "in");
+    *pos = c;
+    if (words != NULL) {
+        *pos = skip_blank(words);
+        if (**pos != SEMI && **pos != NEWLINE && **pos != '\0') {
+            node *line = compile_pipeline(pos, 0, pl);
+            if (line == NULL) {
+                release_node(n);
+                return NULL;
+            }
+            n->line = line->line;
+            line->line = NULL;
+            release_node(line);
+            if (n->line->cmd_count > 1 || n->line->background ||
+                n->line->rstdin != NO_WORD || n->line->rstdout != NO_WORD) {
+                fprintf(stderr, "for: expected words\n");
+                release_node(n);
+                return NULL;
+            }
+        }
+    }
+
+    // The words end like a command, and do follows
+    c = skip_blank(*pos);
+    if (*c == SEMI || *c == NEWLINE) {
+        c++;
+    }
+    c = skip_space(c);
+    if (*c == '\0') {
+        incomplete = 1;
+        release_node(n);
+        return NULL;
+    }
+    *pos = reserved_word(c, "do");
+    if (*pos == NULL) {
+        fprintf(stderr, "for: expected do\n");
+        release_node(n);
+        return NULL;
+    }
+
+    n->body = compile_list(pos, done_word, NULL, pl);
+    if (n->body == NULL) {
+        release_node(n);
+        return NULL;
+    }
+    return n;
+
+}
+
+
+// Compiles a pipe where at least one stage is a group, or a group on its
+// own. Each stage that is not a group is a single command. A pipe with a
+// single stage is the group itself, unless it runs in the background
+static node *compile_stages(char **pos, parsed_line *pl) {
+
+    node *n = new_node(NODE_PIPE);
+    if (n == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    node **tail = &n->body;
+
+    while (1) {
+        char *c = skip_blank(*pos);
+        *pos = c;
+        node *stage = *c == LPAREN || reserved_word(c, "{") ?
+                      compile_group(pos, pl) : compile_pipeline(pos, 1, pl);
+        if (stage == NULL) {
+            release_node(n);
+            return NULL;
+        }
+        *tail = stage;
+        tail = &stage->next;
+
+        c = skip_blank(*pos);
+        if (!is_pipe(*c)) {
+            break;
+        }
+        // The next stage may be on the next line
+        *pos = skip_space(c + 1);
+        if (**pos == '\0') {
+            incomplete = 1;
+            release_node(n);
+            return NULL;
+        }
+    }
+
+    char *c = skip_blank(*pos);
+    if (is_bg(*c)) {
+        n->background = 1;
+        *pos = c + 1;
+    } else if (n->body->next == NULL) {
+        node *group = retain_node(n->body);
+        n->body = NULL;
+        release_node(n);
+        return group;
+    }
+    return n;
+
+}
+
+
+// Compiles ( list ) or { list; } and the redirections that follow it
+static node *compile_group(char **pos, parsed_line *pl) {
+
+    int subshell = **pos == LPAREN;
+    node *n = new_node(subshell ? NODE_SUBSHELL : NODE_GROUP);
+    if (n == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    *pos += 1;
+    n->body = compile_list(pos, subshell ? paren_end : brace_end, NULL, pl);
+    if (n->body == NULL || compile_redirects(pos, n) < 0) {
+        release_node(n);
+        return NULL;
+    }
+    return n;
+
+}
+
+
+// Takes the redirections after a group. Their targets are kept as written,
+// and expanded each time the group runs. A here-document cannot be given
+// to a group, since its lines would have to be cut out of the text
+static int compile_redirects(char **pos, node *n) {
+
+    char *c = skip_blank(*pos);
+    while (is_rdin(*c) || is_rdout(*c)) {
+        const char *token = spec_token(&c);
+        if (is_here(token) && token[2] == '\0') {
+            fprintf(stderr, "Here-documents cannot be given to a group\n");
+            return -1;
+        }
+
+        int flags;
+        char *word = skip_blank(c);
+        c = (char *) scan_word(word, &flags);
+        if (flags & WORD_OPEN) {
+            fprintf(stderr, "Unterminated quote\n");
+            return -1;
+        }
+        if (c == word) {
+            fprintf(stderr, "Expected a file after %s\n", token);
+            return -1;
+        }
+
+        char **target = is_rdout(*token) ? &n->rstdout : &n->rstdin;
+        free(*target);
+        *target = strndup(word, c - word);
+        if (*target == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        if (is_rdin(*token)) {
+            n->rstdin_kind = is_here(token) ? INPUT_HERESTRING : INPUT_FILE;
+        }
+        c = skip_blank(c);
+    }
+    *pos = c;
+    return 0;
+
+}
+
+
+// Compiles a pipeline, or a single command if it is a stage of a pipe
+// that has groups
+static node *compile_pipeline(char **pos, int stage, parsed_line *pl) {
+
+    char *c = *pos;
+    char *end = stage ? stage_end(c) : pipeline_end(c);
+    if (end == NULL) {
+        return NULL;
+    }
+
+    // The lexer needs the pipeline to end the string. What comes after it
+    // is put back once the words are copied out
+    char next = *end;
+    char *cut = NULL;
+    char *rest = NULL;
+    *end = '\0';
+    if (lex_line(c, pl) < 0 || (pl->rstdin_kind == INPUT_HEREDOC &&
+                                take_heredoc(end, next, pl, &cut, &rest) < 0)) {
+        *end = next;
+        return NULL;
+    }
+
+    node *n = new_node(NODE_PIPELINE);
+    if (n == NULL || (n->line = store_line(pl)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        release_node(n);
+        n = NULL;
+    }
+    *end = next;
+    if (cut) {
+        memmove(cut, rest, strlen(rest) + 1);
+    }
+    *pos = end;
+    return n;
+
+}
+
+
+// Makes the lines of a here-document the stdin target of the pipeline just
+// lexed. They start on the line after the one the pipeline ends on, which
+// ends at end, where next was. Sets cut and rest to where the lines start
+// and to what follows the delimiter line, for the caller to cut them out of
+// the text once the pipeline is stored. The here-document is expanded when
+// the pipeline is run, unless its delimiter was quoted.
+// Returns -1 if the delimiter line is not found
+static int take_heredoc(char *end, char next, parsed_line *pl,
+                        char **cut, char **rest) {
+
+    char *delim = pl->rstdin;
+    if (pl->rstdin_flags & WORD_DYNAMIC) {
+        *unquote(delim, delim + strlen(delim)) = '\0';
+    }
+    size_t delim_len = strlen(delim);
+
+    char *line_end = next == NEWLINE ? end : NULL;
+    if (next != NEWLINE && next != '\0') {
+        line_end = strchr(end + 1, NEWLINE);
+    }
+    for (char *c = line_end ? line_end + 1 : NULL; c; ) {
+        char *eol = strchr(c, NEWLINE);
+        size_t len = eol ? (size_t) (eol - c) : strlen(c);
+        if (len == delim_len && !strncmp(c, delim, len)) {
+            *cut = line_end + 1;
+            *rest = eol ? eol + 1 : c + len;
+            *c = '\0';
+            pl->rstdin_flags = !pl->rstdin_flags && strpbrk(*cut, "$\\") ?
+                               WORD_DYNAMIC : 0;
+            pl->rstdin = *cut;
+            return 0;
+        }
+        c = eol ? eol + 1 : NULL;
+    }
+
+    incomplete = 1;
+    return -1;
+
+}
+
+
+// Moves pos past what separates a command from the next. That is a ; or a
+// newline, unless the command ran in the background and so ended with a &,
+// or is the last of the list
+static int end_command(char **pos, const char *const *end_words) {
+
+    char *c = skip_blank(*pos);
+    int matched;
+
+    if (*c == SEMI || *c == NEWLINE) {
+        *pos = c + 1;
+        return 0;
+    }
+    if (*c == '\0' || is_bg((*pos)[-1]) ||
+        (end_words && any_word(c, end_words, &matched))) {
+        *pos = c;
+        return 0;
+    }
+
+    fprintf(stderr, "Unexpected %.*s\n", (int) strcspn(c, " \t\n"), c);
+    return -1;
+
+}
+
+
+// Lexes a pipeline and puts in the aliases it uses
+static int lex_line(char *text, parsed_line *pl) {
+
+    if (parse_raw(text, pl) < 0) {
+        return -1;
+    }
+    if (apply_aliases(pl) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    return 0;
+
+}
+
+
+// Finds where the pipeline starting at c ends: at a separator, parenthesis
+// or newline, at the end of the text, or just after a &.
+// Returns NULL if a quote is not closed
+static char *pipeline_end(char *c) {
+
+    int flags;
+    while (*c != '\0' && *c != NEWLINE && !is_sep(*c)) {
+        if (is_bg(*c)) {
+            return c + 1;
+        }
+        if (is_spec(*c) || isspace(*c)) {
+            c++;
+            continue;
+        }
+        c = (char *) scan_word(c, &flags);
+        if (flags & WORD_OPEN) {
+            fprintf(stderr, "Unterminated quote\n");
+            return NULL;
+        }
+    }
+    return c;
+
+}
+
+
+// Finds where a command that is a stage of a pipe with groups ends, which
+// is also at a pipe, and before a & that runs the whole pipe.
+// Returns NULL if a quote is not closed
+static char *stage_end(char *c) {
+
+    int flags;
+    while (*c != '\0' && *c != NEWLINE && !is_sep(*c) && !is_pipe(*c) &&
+           !is_bg(*c)) {
+        if (is_spec(*c) || isspace(*c)) {
+            c++;
+            continue;
+        }
+        c = (char *) scan_word(c, &flags);
+        if (flags & WORD_OPEN) {
+            fprintf(stderr, "Unterminated quote\n");
+            return NULL;
+        }
+    }
+    return c;
+
+}
+
+
+// Checks if a later stage of the pipeline starting at c is a group
+static int has_group_stage(char *c) {
+
+    int flags = 0;
+    while (*c != '\0' && *c != NEWLINE && !is_sep(*c) &&
+           !(flags & WORD_OPEN)) {
+        if (is_pipe(*c)) {
+            char *next = skip_blank(c + 1);
+            if (*next == LPAREN || reserved_word(next, "{")) {
+                return 1;
+            }
+        }
+        if (is_spec(*c) || isspace(*c)) {
+            c++;
+            continue;
+        }
+        c = (char *) scan_word(c, &flags);
+    }
+    return 0;
+
+}
+
+
+// Checks if a function definition, name(), starts at c. If so, returns
+// where the body should follow and sets name_end. Otherwise returns NULL
+static char *funcdef(char *c, char **name_end) {
+
+    if (!is_name_start(*c)) {
+        return NULL;
+    }
+    char *end = c + 1;
+    while (is_name_char(*end)) {
+        end++;
+    }
+
+    char *paren = skip_blank(end);
+    if (*paren != LPAREN) {
+        return NULL;
+    }
+    paren = skip_blank(paren + 1);
+    if (*paren != RPAREN) {
+        return NULL;
+    }
+
+    *name_end = end;
+    return paren + 1;
+
+}
+
+
+// Checks if the unquoted word at c is the given reserved word.
+// Returns where the word ends if so, and NULL otherwise
+static char *reserved_word(char *c, const char *word) {
+
+    size_t len = strlen(word);
+    if (strncmp(c, word, len)) {
+        return NULL;
+    }
+    char after = c[len];
+    return after == '\0' || isspace(after) || is_spec(after) ? c + len : NULL;
+
+}
+
+
+// Checks if the word at c is one of a NULL terminated list of reserved
+// words. Returns where it ends and sets matched to its index if so
+static char *any_word(char *c, const char *const *words, int *matched) {
+
+    for (int i = 0; words[i]; ++i) {
+        char *end = reserved_word(c, words[i]);
+        if (end != NULL) {
+            if (matched != NULL) {
+                *matched = i;
+            }
+            return end;
+        }
+    }
+    return NULL;
+
+}
+
+
+// Skips whitespace, newlines included
+static char *skip_space(char *c) {
+
+    while (isspace(*c)) {
+        c++;
+    }
+    return c;
+
+}
+
+
+// Skips whitespace within a line
+static char *skip_blank(char *c) {
+
+    while (*c == ' ' || *c == '\t') {
+        c++;
+    }
+    return c;
+
+}
+
+
+// Returns a node of the given type, with the reference of its creator
+static node *new_node(enum node_type type) {
+
+    node *n = calloc(1, sizeof(node));
+    if (n != NULL) {
+        n->type = type;
+        n->refs = 1;
+    }
+    return n;
+
+}
@@ -0,0 +1,52 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#define FUNC_DEPTH_MAX  1000 // How deeply function calls may nest
+#define LINE_INCOMPLETE (-2) // run_line needs more lines to finish a command
+
+typedef struct pl parsed_line;
+typedef struct sl stored_line;
+
+enum node_type {
+    NODE_PIPELINE, // A line of commands, stored as lexed
+    NODE_FUNCDEF,  // name() { list; }
+    NODE_IF,       // if cond; then body; else alt; fi
+    NODE_WHILE,    // while cond; do body; done, or until
+    NODE_FOR,      // for name in line; do body; done
+    NODE_GROUP,    // { body; }, run in the shell
+    NODE_SUBSHELL, // ( body ), run in a child process
+    NODE_PIPE      // Stages joined by pipes, in body, when one is a group
+};
+
+// A compiled command. Lists of them are linked through next. A whole list
+// may be held by more than one owner, such as the function table and a call
+// running the function, and is freed when the last one lets it go.
+// A compound command is compiled once, and each time its commands run they
+// are loaded and expanded from their stored form without being lexed again
+typedef struct n {
+    enum node_type type;
+    struct n *next;
+    unsigned int refs;  // Only counted for the first node of a list
+    stored_line *line;  // A pipeline, or the words a for loop goes through
+    char *name;         // Name of a function, or of the variable of a loop
+    struct n *cond;     // What an if or a loop tests
+    struct n *body;
+    struct n *alt;      // What an if runs otherwise: else, or the next elif
+    int until;          // A while loop that runs until cond succeeds
+    char *rstdin;       // Redirections of a group, expanded when it runs
+    char *rstdout;
+    int rstdin_kind;
+    int background;     // A pipe not waited for
+} node;
+
+int run_line(char *line, parsed_line *pl);
+void set_run_hook(void (*hook)(void));
+void interrupt_commands();
+int run_list(node *list, parsed_line *pl);
+int call_function(node *body, char **args, parsed_line *pl);
+int return_from_function(int status);
+int leave_loops(int count, int next_iteration);
+node *retain_node(node *n);
+void release_node(node *n);
+
+#endif
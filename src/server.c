@@ -0,0 +1,393 @@
+#define _GNU_SOURCE // pipe2 and accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "parser.h"
+#include "buffers.h"
+#include "vars.h"
+#include "builtins.h"
+#include "script.h"
+#include "server.h"
+#include "workdir.h"
+
+// A session serves one client. It is a process forked from the server
+// when the client connects, with stdout and stderr pointed at pipes that
+// a relay thread reads and sends on to the client as frames. Commands run
+// by the session write to the pipes directly. The status of each line goes
+// to the relay through a pipe of its own, so it is sent after the output
+// that came before it
+static struct {
+    pid_t pid;
+    int sock;
+    int out;     // Read ends of the pipes stdout and stderr point to
+    int err;
+    int ctl[2];  // Statuses of lines, closed when the session ends
+    int gone;    // The client can no longer be written to
+    pthread_t relay;
+} session;
+
+static char relay_buf[RELAY_BUF_SIZE];
+
+static int listen_at(const char *path);
+static void run_session(int client, parsed_line *pl);
+static void run_frame(unsigned char type, char *payload, parsed_line *pl);
+static int start_relay();
+static void end_session();
+static void *relay_thread(void *arg);
+static int relay(int fd, unsigned char type);
+static int send_frame(unsigned char type, const void *payload, uint32_t len);
+static int read_full(int fd, void *buf, size_t len);
+
+
+// Runs a command server on a Unix socket at path. Each client gets a
+// session of its own, so the working directory, variables and functions
+// it sets are kept from the others, and sessions run at the same time.
+// Returns -1 if the socket cannot be set up, and otherwise never
+int serve(const char *path, parsed_line *pl) {
+
+    int sock = listen_at(path);
+    if (sock < 0) {
+        return -1;
+    }
+
+    // Interrupting the server stops it. Sessions are not waited for
+    signal(SIGINT, SIG_DFL);
+    signal(SIGCHLD, SIG_IGN);
+
+    while (1) {
+        int client = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "Accept error\n");
+            }
+            continue;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            run_session(client, pl);
+        } else if (pid == -1) {
+            fprintf(stderr, "Fork error\n");
+        }
+        close(client);
+    }
+
+}
+
+
+// Binds the socket at path, which only the user running the server can
+// connect to, since sessions run commands as that user.
+// Returns -1 if that fails or another server is listening there already
+static int listen_at(const char *path) {
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left by an earlier server is replaced, but not one a
+    // server still answers on
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        int live = probe >= 0 &&
+                   connect(probe, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (live) {
+            fprintf(stderr, "A server is already listening on %s\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        fprintf(stderr, "Unable to listen on %s\n", path);
+        return -1;
+    }
+    mode_t old_mask = umask(S_IRWXG|S_IRWXO|S_IXUSR);
+    int res = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+    umask(old_mask);
+    if (res < 0 || listen(sock, SERVE_BACKLOG) < 0) {
+        fprintf(stderr, "Unable to listen on %s\n", path);
+        close(sock);
+        return -1;
+    }
+    return sock;
+
+}
+
+
+// Reads frames from a client and acts on them until it disconnects
+static void run_session(int client, parsed_line *pl) {
+
+    // Commands of the session are waited for as usual
+    signal(SIGCHLD, SIG_DFL);
+    session.pid = getpid();
+    session.sock = client;
+
+    if (start_relay() < 0) {
+        _exit(EXIT_FAILURE);
+    }
+    atexit(end_session);
+
+    char *payload = NULL;
+    size_t size = 0;
+
+    while (1) {
+        unsigned char header[5];
+        if (read_full(client, header, sizeof(header)) < 0) {
+            break;
+        }
+        uint32_t len;
+        memcpy(&len, header + 1, sizeof(len));
+        len = ntohl(len);
+        if (len > FRAME_MAX) {
+            fprintf(stderr, "Frame too long\n");
+            break;
+        }
+
+        if (len + 1 > size) {
+            char *grown = realloc(payload, len + 1);
+            if (grown == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                break;
+            }
+            payload = grown;
+            size = len + 1;
+        }
+        if (read_full(client, payload, len) < 0) {
+            break;
+        }
+        payload[len] = '\0';
+
+        run_frame(header[0], payload, pl);
+    }
+
+    exit(EXIT_SUCCESS);
+
+}
+
+
+static void run_frame(unsigned char type, char *payload, parsed_line *pl) {
+
+    if (type == FRAME_LINE) {
+        int status = run_line(payload, pl);
+        // The whole line came in one frame, so there is no more of it
+        if (status < 0) {
+            fprintf(stderr, "Parse error\n");
+            status = STATUS_PARSE;
+        }
+        fflush(stdout);
+        uint32_t net = htonl(status);
+        if (write(session.ctl[1], &net, sizeof(net)) < 0) {
+            exit(EXIT_FAILURE);
+        }
+
+    } else if (type == FRAME_CWD) {
+        if (change_dir(payload) < 0) {
+            fprintf(stderr, "Directory not found\n");
+        }
+
+    } else if (type == FRAME_ENV) {
+        size_t len = is_assignment(payload);
+        if (len == 0 || set_var(payload, len, payload + len + 1, 1) < 0) {
+            fprintf(stderr, "Bad variable %s\n", payload);
+            return;
+        }
+        var_changed(payload, len);
+    }
+
+}
+
+
+// Points stdout and stderr at pipes and starts the thread relaying them,
+// and stdin at /dev/null
+static int start_relay() {
+
+    int out[2], err[2];
+    if (pipe2(out, O_CLOEXEC) < 0 || pipe2(err, O_CLOEXEC) < 0 ||
+        pipe2(session.ctl, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    int null = open("/dev/null", O_RDONLY);
+    if (null < 0) {
+        return -1;
+    }
+    dup2(null, 0);
+    dup2(out[1], 1);
+    dup2(err[1], 2);
+    close(null);
+    close(out[1]);
+    close(err[1]);
+
+    // Reading stops when a pipe is empty, so a status can follow
+    session.out = out[0];
+    session.err = err[0];
+    fcntl(session.out, F_SETFL, O_NONBLOCK);
+    fcntl(session.err, F_SETFL, O_NONBLOCK);
+
+    // Signals are for the main thread to handle
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int res = pthread_create(&session.relay, NULL, relay_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return res == 0 ? 0 : -1;
+
+}
+
+
+// Lets the relay send what is left once the session exits, whether the
+// client went away or a command such as exit ended it. Background jobs
+// may still hold the pipes, so the relay does not wait for them
+static void end_session() {
+
+    // A forked child running a function exits through here too
+    if (getpid() != session.pid) {
+        return;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    close(session.ctl[1]);
+    pthread_join(session.relay, NULL);
+
+}
+
+
+static void *relay_thread(void *arg) {
+
+    struct pollfd fds[3] = {
+        { session.out, POLLIN, 0 },
+        { session.err, POLLIN, 0 },
+        { session.ctl[0], POLLIN, 0 }
+    };
+    while (1) {
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents && relay(session.out, FRAME_STDOUT) == 0) {
+            fds[0].fd = -1;
+        }
+        if (fds[1].revents && relay(session.err, FRAME_STDERR) == 0) {
+            fds[1].fd = -1;
+        }
+        if (fds[2].revents) {
+            uint32_t status;
+            ssize_t n = read(session.ctl[0], &status, sizeof(status));
+
+            // The commands of the line have finished,
+            // so all they wrote is in the pipes already
+            while (relay(session.out, FRAME_STDOUT) > 0) {
+                ;
+            }
+            while (relay(session.err, FRAME_STDERR) > 0) {
+                ;
+            }
+            if (n != sizeof(status)) {
+                break;
+            }
+            if (!session.gone &&
+                send_frame(FRAME_STATUS, &status, sizeof(status)) < 0) {
+                session.gone = 1;
+            }
+        }
+    }
+    return NULL;
+
+}
+
+
+// Reads what is in a pipe and sends it to the client. Once the client is
+// gone, output is still read, so commands do not block on a full pipe.
+// Returns the number of bytes read, 0 at the end of the pipe,
+// and -1 if it is empty
+static int relay(int fd, unsigned char type) {
+
+    ssize_t n = read(fd, relay_buf, sizeof(relay_buf));
+    if (n > 0 && !session.gone && send_frame(type, relay_buf, n) < 0) {
+        session.gone = 1;
+    }
+    return n;
+
+}
+
+
+static int send_frame(unsigned char type, const void *payload, uint32_t len) {
+
+    unsigned char header[5];
+    uint32_t net = htonl(len);
+    header[0] = type;
+    memcpy(header + 1, &net, sizeof(net));
+
+    struct iovec iov[2] = {
+        { header, sizeof(header) },
+        { (void *) payload, len }
+    };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 2;
+
+    // Stream sockets may take only part of it
+    size_t left = sizeof(header) + len;
+    while (left > 0) {
+        ssize_t sent = sendmsg(session.sock, &mh, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        left -= sent;
+        while (mh.msg_iovlen > 0 && (size_t) sent >= mh.msg_iov->iov_len) {
+            sent -= mh.msg_iov->iov_len;
+            mh.msg_iov++;
+            mh.msg_iovlen--;
+        }
+        if (mh.msg_iovlen > 0) {
+            mh.msg_iov->iov_base = (char *) mh.msg_iov->iov_base + sent;
+            mh.msg_iov->iov_len -= sent;
+        }
+    }
+    return 0;
+
+}
+
+
+static int read_full(int fd, void *buf, size_t len) {
+
+    char *pos = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, pos, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        pos += n;
+        len -= n;
+    }
+    return 0;
+
+}
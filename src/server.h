@@ -0,0 +1,28 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVE_ARG      "--serve"   // bunsh --serve path runs a command server
+#define SERVE_BACKLOG  64          // Connections waiting to be accepted
+#define FRAME_MAX      (1 << 20)   // Longest payload a client may send
+#define RELAY_BUF_SIZE (1 << 16)   // Output read per frame
+#define STATUS_PARSE   2           // Sent for a line that cannot be parsed
+
+// Frames go both ways as a type byte, the length of the payload as a
+// 32 bit big-endian number, and the payload
+enum frame_type {
+    // From clients
+    FRAME_LINE   = 'L', // A command line, run as if typed at the prompt
+    FRAME_CWD    = 'C', // A directory to change to
+    FRAME_ENV    = 'V', // name=value, set and exported
+    // To clients
+    FRAME_STDOUT = 'O',
+    FRAME_STDERR = 'E',
+    FRAME_STATUS = 'S'  // Exit status of a line as a 32 bit big-endian
+                        // number, sent after all output of the line
+};
+
+typedef struct pl parsed_line;
+
+int serve(const char *path, parsed_line *pl);
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "buffers.h"
+#include "stored.h"
+
+#define item_offsets(sl) ((sl)->data + (sl)->cmd_count)
+#define item_flags(sl)   ((uint8_t *) (item_offsets(sl) + (sl)->item_count))
+
+static uint32_t put_word(stored_line *sl, uint32_t *pos, const char *word);
+
+
+// Copies a lexed line, which has not been expanded, into a stored line.
+// Returns NULL if out of memory
+stored_line *store_line(const parsed_line *pl) {
+
+    command *first = pl->cmd_buf->start;
+    uint32_t cmd_count = pl->pipe_count + 1;
+    uint32_t item_count = 0;
+    size_t strings = 0;
+
+    for (uint32_t i = 0; i < cmd_count; ++i) {
+        item_count += first[i].length;
+        for (size_t j = 0; j < first[i].length; ++j) {
+            strings += strlen(first[i].items[j]) + 1;
+        }
+    }
+    if (pl->rstdin) {
+        strings += strlen(pl->rstdin) + 1;
+    }
+    if (pl->rstdout) {
+        strings += strlen(pl->rstdout) + 1;
+    }
+
+    size_t size = sizeof(stored_line) +
+                  (cmd_count + item_count) * sizeof(uint32_t) +
+                  item_count + strings;
+    stored_line *sl = malloc(size);
+    if (sl == NULL) {
+        return NULL;
+    }
+
+    sl->size = size;
+    sl->cmd_count = cmd_count;
+    sl->item_count = item_count;
+    sl->rstdin_flags = pl->rstdin_flags;
+    sl->rstdout_flags = pl->rstdout_flags;
+    sl->rstdin_kind = pl->rstdin_kind;
+    sl->background = pl->background;
+
+    uint32_t *offsets = item_offsets(sl);
+    uint8_t *flags = item_flags(sl);
+    uint32_t pos = (char *) (flags + item_count) - (char *) sl;
+
+    for (uint32_t i = 0; i < cmd_count; ++i) {
+        sl->data[i] = first[i].length;
+        size_t buf_pos = first[i].items - pl->item_buf->start;
+        for (size_t j = 0; j < first[i].length; ++j) {
+            *flags++ = pl->item_buf->flags[buf_pos + j];
+            *offsets++ = put_word(sl, &pos, first[i].items[j]);
+        }
+    }
+    sl->rstdin  = pl->rstdin ? put_word(sl, &pos, pl->rstdin) : NO_WORD;
+    sl->rstdout = pl->rstdout ? put_word(sl, &pos, pl->rstdout) : NO_WORD;
+
+    return sl;
+
+}
+
+
+// Sets up the parse structure with the commands of a stored line, the way
+// lexing the line would have. The items point into the stored line, so it
+// has to outlive the use of them. Returns -1 if out of memory
+int load_line(const stored_line *sl, parsed_line *pl) {
+
+    if (check_buffers(pl, sl->item_count, sl->cmd_count - 1) < 0) {
+        return -1;
+    }
+
+    command *cmd = pl->cmd_buf->start;
+    char **items = pl->item_buf->start;
+    unsigned char *flags = pl->item_buf->flags;
+    const uint32_t *offsets = item_offsets(sl);
+    const uint8_t *stored_flags = item_flags(sl);
+
+    for (uint32_t i = 0; i < sl->cmd_count; ++i, ++cmd) {
+        cmd->items = items;
+        cmd->length = sl->data[i];
+        cmd->pipe_depth = i;
+        // Pipeline should appear in reverse order when executing
+        cmd->next = i > 0 ? cmd - 1 : NULL;
+        for (uint32_t j = 0; j < cmd->length; ++j) {
+            *flags++ = *stored_flags++;
+            *items++ = (char *) sl + *offsets++;
+        }
+        *items++ = NULL;
+        flags++;
+    }
+
+    pl->cmd = cmd - 1;
+    pl->pipe_count = sl->cmd_count - 1;
+    pl->rstdin  = sl->rstdin == NO_WORD ? NULL : (char *) sl + sl->rstdin;
+    pl->rstdout = sl->rstdout == NO_WORD ? NULL : (char *) sl + sl->rstdout;
+    pl->rstdin_flags = sl->rstdin_flags;
+    pl->rstdout_flags = sl->rstdout_flags;
+    pl->rstdin_kind = sl->rstdin_kind;
+    pl->background = sl->background;
+    pl->state = ACCEPTING;
+
+    return 0;
+
+}
+
+
+// Returns the number of items of the command at index cmd, the first in the
+// pipeline being 0
+uint32_t stored_length(const stored_line *sl, uint32_t cmd) {
+
+    return sl->data[cmd];
+
+}
+
+
+// Returns item i of the line, counting from the first item of the first
+// command
+char *stored_item(const stored_line *sl, uint32_t i) {
+
+    return (char *) sl + item_offsets(sl)[i];
+
+}
+
+
+int stored_flags(const stored_line *sl, uint32_t i) {
+
+    return item_flags(sl)[i];
+
+}
+
+
+// Copies a word to position pos of the stored line and returns where it went
+static uint32_t put_word(stored_line *sl, uint32_t *pos, const char *word) {
+
+    uint32_t at = *pos;
+    size_t len = strlen(word) + 1;
+    memcpy((char *) sl + at, word, len);
+    *pos += len;
+    return at;
+
+}
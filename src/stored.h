@@ -0,0 +1,35 @@
+#ifndef STORED_H
+#define STORED_H
+
+#include <stdint.h>
+
+#define NO_WORD UINT32_MAX // Offset of a redirection target that is not set
+
+typedef struct pl parsed_line;
+
+// A line as the lexer left it, before expansion, copied into one block of
+// memory that points nowhere. Commands and items are kept as counts and
+// offsets from the start of the block, so it can be moved or copied as it
+// is, and loading it back into the parse buffers takes no lexing.
+// After the header come the length of each command, the offset of each
+// item, the flags of each item and then the strings
+typedef struct sl {
+    uint32_t size;        // Bytes in the whole block
+    uint32_t cmd_count;
+    uint32_t item_count;  // Not counting the NULL ending each command
+    uint32_t rstdin;
+    uint32_t rstdout;
+    uint8_t rstdin_flags;
+    uint8_t rstdout_flags;
+    uint8_t rstdin_kind;
+    uint8_t background;
+    uint32_t data[];
+} stored_line;
+
+stored_line *store_line(const parsed_line *pl);
+int load_line(const stored_line *sl, parsed_line *pl);
+uint32_t stored_length(const stored_line *sl, uint32_t cmd);
+char *stored_item(const stored_line *sl, uint32_t i);
+int stored_flags(const stored_line *sl, uint32_t i);
+
+#endif
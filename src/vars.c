@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "vars.h"
+
+// All shell variables, in a hash table with chained buckets.
+// The environment given to commands is built from the exported ones
+// when it is asked for after a change, and reused otherwise.
+static struct {
+    shell_var **buckets;
+    size_t bucket_count;
+    size_t count;
+    char **envp;
+    int envp_dirty;
+} vars;
+
+// Positional parameters of the function being run
+static param_list params;
+static int last_status; // Of the last command run, for $?
+
+static shell_var *find_var(const char *name, size_t len, unsigned int hash);
+static int grow_table();
+
+
+// Sets up the table with the variables of an environment, all exported
+int init_vars(char **envp) {
+
+    vars.bucket_count = VAR_BUCKETS_MIN;
+    vars.buckets = calloc(vars.bucket_count, sizeof(shell_var *));
+    if (vars.buckets == NULL) {
+        return -1;
+    }
+    vars.envp_dirty = 1;
+
+    for (char **e = envp; e && *e; ++e) {
+        char *eq = strchr(*e, '=');
+        if (eq == NULL || eq == *e) {
+            continue;
+        }
+        if (set_var(*e, eq - *e, eq + 1, 1) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+
+// Returns the value of a variable, or NULL if it is not set
+const char *get_var(const char *name) {
+
+    return get_var_n(name, strlen(name));
+
+}
+
+
+// Same as get_var, for a name that is not null terminated
+const char *get_var_n(const char *name, size_t len) {
+
+    shell_var *v = find_var(name, len, hash_name(name, len));
+    return v ? v->entry + v->name_len + 1 : NULL;
+
+}
+
+
+// Gives a variable a new value, creating it if needed. If export is set,
+// the variable is also exported. Returns -1 if out of memory
+int set_var(const char *name, size_t name_len, const char *value, int export) {
+
+    unsigned int hash = hash_name(name, name_len);
+    shell_var *v = find_var(name, name_len, hash);
+
+    size_t value_len = strlen(value);
+    char *entry = malloc(name_len + value_len + 2);
+    if (entry == NULL) {
+        return -1;
+    }
+    memcpy(entry, name, name_len);
+    entry[name_len] = '=';
+    memcpy(entry + name_len + 1, value, value_len + 1);
+
+    if (v == NULL) {
+        if (vars.count + 1 > vars.bucket_count / 4 * 3 && grow_table() < 0) {
+            free(entry);
+            return -1;
+        }
+        v = calloc(1, sizeof(shell_var));
+        if (v == NULL) {
+            free(entry);
+            return -1;
+        }
+        v->hash = hash;
+        v->name_len = name_len;
+        shell_var **bucket = &vars.buckets[hash & (vars.bucket_count - 1)];
+        v->next = *bucket;
+        *bucket = v;
+        vars.count++;
+    }
+
+    free(v->entry);
+    v->entry = entry;
+    v->exported |= export;
+    // The old entry may be in the environment array
+    vars.envp_dirty |= v->exported;
+
+    return 0;
+
+}
+
+
+// Marks a variable as exported, creating it empty if it is not set
+int export_var(const char *name) {
+
+    size_t len = strlen(name);
+    shell_var *v = find_var(name, len, hash_name(name, len));
+    if (v == NULL) {
+        return set_var(name, len, "", 1);
+    }
+    vars.envp_dirty |= !v->exported;
+    v->exported = 1;
+    return 0;
+
+}
+
+
+// Removes a variable. Returns -1 if it was not set
+int unset_var(const char *name) {
+
+    size_t len = strlen(name);
+    unsigned int hash = hash_name(name, len);
+    shell_var **link = &vars.buckets[hash & (vars.bucket_count - 1)];
+
+    for (; *link; link = &(*link)->next) {
+        shell_var *v = *link;
+        if (v->hash == hash && v->name_len == len &&
+            !memcmp(v->entry, name, len)) {
+            *link = v->next;
+            vars.envp_dirty |= v->exported;
+            vars.count--;
+            free(v->entry);
+            free(v);
+            return 0;
+        }
+    }
+
+    return -1;
+
+}
+
+
+// Checks if a word has the form name=value. Returns the length of the name,
+// or 0 if it is not an assignment
+int is_assignment(const char *word) {
+
+    if (!is_name_start(*word)) {
+        return 0;
+    }
+    const char *c = word + 1;
+    while (is_name_char(*c)) {
+        c++;
+    }
+    return *c == '=' ? c - word : 0;
+
+}
+
+
+// Returns the environment for commands: a NULL terminated array of the
+// exported variables. It is only rebuilt after exported variables change
+char **get_envp() {
+
+    if (!vars.envp_dirty) {
+        return vars.envp;
+    }
+
+    char **envp = malloc((vars.count + 1) * sizeof(char *));
+    if (envp == NULL) {
+        return vars.envp;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < vars.bucket_count; ++i) {
+        for (shell_var *v = vars.buckets[i]; v; v = v->next) {
+            if (v->exported) {
+                envp[n++] = v->entry;
+            }
+        }
+    }
+    envp[n] = NULL;
+
+    free(vars.envp);
+    vars.envp = envp;
+    vars.envp_dirty = 0;
+    return envp;
+
+}
+
+
+// Lists the exported variables the way export takes them
+void print_exported() {
+
+    for (char **e = get_envp(); e && *e; ++e) {
+        printf("export %s\n", *e);
+    }
+
+}
+
+
+// Makes a list of arguments the positional parameters and returns the
+// previous ones, for the caller to put back when the function returns
+param_list set_params(param_list new_params) {
+
+    param_list old = params;
+    params = new_params;
+    return old;
+
+}
+
+
+const param_list *get_params() {
+
+    return &params;
+
+}
+
+
+void set_last_status(int status) {
+
+    last_status = status;
+
+}
+
+
+int get_last_status() {
+
+    return last_status;
+
+}
+
+
+// FNV-1a. Also hashes the names of functions and aliases
+unsigned int hash_name(const char *name, size_t len) {
+
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+
+}
+
+
+static shell_var *find_var(const char *name, size_t len, unsigned int hash) {
+
+    if (vars.buckets == NULL) {
+        return NULL;
+    }
+    shell_var *v = vars.buckets[hash & (vars.bucket_count - 1)];
+    for (; v; v = v->next) {
+        if (v->hash == hash && v->name_len == len &&
+            !memcmp(v->entry, name, len)) {
+            return v;
+        }
+    }
+    return NULL;
+
+}
+
+
+// Doubles the number of buckets, moving the variables
+// to the buckets their hashes now select
+static int grow_table() {
+
+    size_t count = vars.bucket_count * 2;
+    shell_var **buckets = calloc(count, sizeof(shell_var *));
+    if (buckets == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < vars.bucket_count; ++i) {
+        shell_var *v = vars.buckets[i];
+        while (v) {
+            shell_var *next = v->next;
+            shell_var **bucket = &buckets[v->hash & (count - 1)];
+            v->next = *bucket;
+            *bucket = v;
+            v = next;
+        }
+    }
+
+    free(vars.buckets);
+    vars.buckets = buckets;
+    vars.bucket_count = count;
+    return 0;
+
+}
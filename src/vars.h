@@ -0,0 +1,47 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+
+#define VAR_BUCKETS_MIN 256 // Initial size of the table, a power of two
+
+#define is_name_start(c) (((c) >= 'a' && (c) <= 'z') || \
+                          ((c) >= 'A' && (c) <= 'Z') || (c) == '_')
+#define is_name_char(c)  (is_name_start(c) || ((c) >= '0' && (c) <= '9'))
+
+// Parameters named by a single character: $0 to $9, $#, $@ and $?
+#define is_special_param(c) (((c) >= '0' && (c) <= '9') || (c) == '#' || \
+                             (c) == '@' || (c) == '?')
+
+// A shell variable. The name and value are kept together as "name=value",
+// which is the form exec wants for the environment
+typedef struct v {
+    struct v *next; // Next variable in the same bucket
+    unsigned int hash;
+    size_t name_len;
+    int exported;
+    char *entry;
+} shell_var;
+
+// The arguments a function was called with, $1 and on
+typedef struct pp {
+    char **args;
+    size_t count;
+} param_list;
+
+int init_vars(char **envp);
+const char *get_var(const char *name);
+const char *get_var_n(const char *name, size_t len);
+int set_var(const char *name, size_t name_len, const char *value, int export);
+int export_var(const char *name);
+int unset_var(const char *name);
+int is_assignment(const char *word);
+char **get_envp();
+void print_exported();
+param_list set_params(param_list params);
+const param_list *get_params();
+void set_last_status(int status);
+int get_last_status();
+unsigned int hash_name(const char *name, size_t len);
+
+#endif
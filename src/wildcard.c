@@ -0,0 +1,542 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include "wildcard.h"
+
+// Layout of the records returned by getdents64, which has 64 bit inode
+// numbers and offsets whatever ino_t and off_t are in this build
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// The names in a directory, each stored as its d_type byte
+// followed by the null terminated name
+typedef struct dl {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *names;
+    size_t len;
+    size_t size;
+} dir_listing;
+
+// A component of the path being expanded. Only components
+// containing wildcards are compiled
+typedef struct pc {
+    const char *text;
+    size_t len;
+    int wild;
+    wildcard_pattern *wp; // Compiled if wild
+} path_component;
+
+// State of the walk through the directories a word can match
+typedef struct pw {
+    char path[PATH_MAX];
+    path_component *comps;
+    size_t comp_count;
+    int dir_only; // The word ended with a slash
+    wildcard_visit visit;
+    void *ctx;
+    int found;
+} path_walk;
+
+// Listings read while expanding the current line. A directory that is
+// unchanged since it was read is not read again
+static dir_listing *dir_cache[DIR_CACHE_SIZE];
+static size_t dir_cache_count;
+static char *dents_buf;
+
+static int walk(path_walk *pw, size_t path_len, size_t ci);
+static int emit(path_walk *pw, size_t path_len);
+static size_t append(path_walk *pw, size_t path_len, const char *s,
+                     size_t len, int unescape);
+static dir_listing *list_dir(const char *path, int *owned);
+static dir_listing *read_dir(const char *path);
+static void free_listing(dir_listing *dl);
+
+
+// Checks if a word contains any unescaped wildcard characters
+int has_wildcards(const char *word) {
+
+    for (const char *c = word; *c; ++c) {
+        if (*c == '\\' && c[1]) {
+            c++;
+        } else if (is_wild(*c)) {
+            return 1;
+        }
+    }
+    return 0;
+
+}
+
+
+// Compiles the first len characters of a pattern. Supports *, ?, [...]
+// with ranges and negation by ! or ^, and backslash escapes. Returns -1 if
+// the pattern is too long to match any name
+int compile_pattern(const char *pat, size_t len, wildcard_pattern *wp) {
+
+    wp->op_count = 0;
+    wp->class_count = 0;
+    wp->min_len = 0;
+    wp->dot_ok = len > 0 && pat[0] == '.';
+
+    const char *end = pat + len;
+    for (const char *c = pat; c < end; ++c) {
+        if (wp->op_count > NAME_MAX) {
+            return -1;
+        }
+
+        unsigned char type = OP_CHAR;
+        unsigned char arg = *c;
+
+        if (*c == '*') {
+            // Consecutive stars are the same as one
+            if (wp->op_count && wp->ops[wp->op_count - 1].type == OP_STAR) {
+                continue;
+            }
+            type = OP_STAR;
+        } else if (*c == '?') {
+            type = OP_ANY;
+        } else if (*c == '\\' && c + 1 < end) {
+            arg = *++c;
+        } else if (*c == '[') {
+            // A ] right after [ or [! is part of the class
+            const char *close = c + 1;
+            if (close < end && (*close == '!' || *close == '^')) {
+                close++;
+            }
+            if (close < end && *close == ']') {
+                close++;
+            }
+            while (close < end && *close != ']') {
+                close++;
+            }
+            // Without a closing bracket, [ is an ordinary character
+            if (close < end && wp->class_count <= NAME_MAX / 2) {
+                unsigned char *bits = wp->classes[wp->class_count];
+                memset(bits, 0, 32);
+                const char *m = c + 1;
+                int negate = *m == '!' || *m == '^';
+                m += negate;
+                do {
+                    unsigned char lo = *m, hi = *m;
+                    if (m + 2 < close && m[1] == '-') {
+                        hi = m[2];
+                        m += 2;
+                    }
+                    for (unsigned int b = lo; b <= hi; ++b) {
+                        bits[b / 8] |= 1 << (b % 8);
+                    }
+                } while (++m < close);
+                if (negate) {
+                    for (int i = 0; i < 32; ++i) {
+                        bits[i] = ~bits[i];
+                    }
+                    bits[0] &= ~1; // Never the terminator
+                }
+                type = OP_CLASS;
+                arg = wp->class_count++;
+                c = close;
+            }
+        }
+
+        wp->ops[wp->op_count].type = type;
+        wp->ops[wp->op_count].arg = arg;
+        wp->op_count++;
+        wp->min_len += type != OP_STAR;
+    }
+
+    return 0;
+
+}
+
+
+// Checks if a name of length len matches a compiled pattern.
+// A star only has to backtrack to the last star seen
+int match_pattern(const wildcard_pattern *wp, const char *name, size_t len) {
+
+    if (len < wp->min_len) {
+        return 0;
+    }
+    // Hidden files have to be asked for
+    if (name[0] == '.' && !wp->dot_ok) {
+        return 0;
+    }
+
+    size_t pi = 0, ni = 0;
+    size_t star_pi = (size_t) -1, star_ni = 0;
+
+    while (ni < len) {
+        if (pi < wp->op_count) {
+            unsigned char c = name[ni];
+            unsigned char arg = wp->ops[pi].arg;
+            int step = 0;
+            switch (wp->ops[pi].type) {
+                case OP_STAR:
+                    star_pi = pi++;
+                    star_ni = ni;
+                    continue;
+                case OP_CHAR:
+                    step = c == arg;
+                    break;
+                case OP_ANY:
+                    step = 1;
+                    break;
+                case OP_CLASS:
+                    step = wp->classes[arg][c / 8] & (1 << (c % 8));
+                    break;
+            }
+            if (step) {
+                pi++;
+                ni++;
+                continue;
+            }
+        }
+        if (star_pi == (size_t) -1) {
+            return 0;
+        }
+        // Let the last star swallow one more character
+        pi = star_pi + 1;
+        ni = ++star_ni;
+    }
+
+    while (pi < wp->op_count && wp->ops[pi].type == OP_STAR) {
+        pi++;
+    }
+    return pi == wp->op_count;
+
+}
+
+
+// Passes each existing path matching a word with wildcards to visit, in
+// directory order. Returns the number of matches, or -1 on error
+int expand_wildcards(const char *word, wildcard_visit visit, void *ctx) {
+
+    size_t max_comps = 1;
+    for (const char *c = word; *c; ++c) {
+        max_comps += *c == '/';
+    }
+
+    path_walk *pw = malloc(sizeof(path_walk));
+    path_component *comps = calloc(max_comps, sizeof(path_component));
+    wildcard_pattern *patterns = NULL;
+    if (pw == NULL || comps == NULL) {
+        free(pw);
+        free(comps);
+        return -1;
+    }
+
+    // Splits the word into the names between slashes
+    size_t comp_count = 0, wild_count = 0;
+    const char *c = word;
+    while (*c) {
+        while (*c == '/') {
+            c++;
+        }
+        if (*c == '\0') {
+            break;
+        }
+        const char *start = c;
+        int wild = 0;
+        while (*c && *c != '/') {
+            if (*c == '\\' && c[1] && c[1] != '/') {
+                c++;
+            } else if (is_wild(*c)) {
+                wild = 1;
+            }
+            c++;
+        }
+        comps[comp_count].text = start;
+        comps[comp_count].len = c - start;
+        comps[comp_count++].wild = wild;
+        wild_count += wild;
+    }
+
+    int res = 0;
+    if (wild_count > 0) {
+        patterns = malloc(wild_count * sizeof(wildcard_pattern));
+        if (patterns == NULL) {
+            res = -1;
+        }
+    }
+
+    wildcard_pattern *next = patterns;
+    for (size_t i = 0; res == 0 && i < comp_count; ++i) {
+        if (comps[i].wild) {
+            comps[i].wp = next++;
+            if (compile_pattern(comps[i].text, comps[i].len, comps[i].wp) < 0) {
+                res = -2; // Cannot match anything
+            }
+        }
+    }
+
+    if (res == 0) {
+        pw->comps = comps;
+        pw->comp_count = comp_count;
+        pw->dir_only = c > word && c[-1] == '/';
+        pw->visit = visit;
+        pw->ctx = ctx;
+        pw->found = 0;
+
+        size_t path_len = 0;
+        if (*word == '/') {
+            pw->path[path_len++] = '/';
+        }
+        res = walk(pw, path_len, 0);
+        if (res >= 0) {
+            res = pw->found;
+        }
+    } else if (res == -2) {
+        res = 0;
+    }
+
+    free(patterns);
+    free(comps);
+    free(pw);
+    return res;
+
+}
+
+
+// Forgets the directory listings read so far. Called when a new line
+// is expanded, since the directories may have changed in between
+void clear_dir_cache() {
+
+    for (size_t i = 0; i < dir_cache_count; ++i) {
+        free_listing(dir_cache[i]);
+    }
+    dir_cache_count = 0;
+
+}
+
+
+// Matches component ci and the ones after it, starting from the
+// directory in the first path_len characters of the path
+static int walk(path_walk *pw, size_t path_len, size_t ci) {
+
+    if (ci == pw->comp_count) {
+        return emit(pw, path_len);
+    }
+
+    path_component *comp = &pw->comps[ci];
+    int last = ci + 1 == pw->comp_count;
+    int need_dir = !last || pw->dir_only;
+
+    if (!comp->wild) {
+        size_t len = append(pw, path_len, comp->text, comp->len, 1);
+        if (len == 0) {
+            return 0;
+        }
+        if (need_dir) {
+            len = append(pw, len, "/", 1, 0);
+        }
+        if (!last) {
+            // Whether it exists shows when the next directory is read
+            return walk(pw, len, ci + 1);
+        }
+        struct stat st;
+        if ((pw->dir_only ? stat(pw->path, &st) : lstat(pw->path, &st)) < 0 ||
+            (pw->dir_only && !S_ISDIR(st.st_mode))) {
+            return 0;
+        }
+        return emit(pw, len);
+    }
+
+    pw->path[path_len] = '\0';
+    int owned;
+    dir_listing *dl = list_dir(path_len ? pw->path : ".", &owned);
+    if (dl == NULL) {
+        return 0;
+    }
+
+    int res = 0;
+    for (char *e = dl->names; res >= 0 && e < dl->names + dl->len; ) {
+        unsigned char type = *e++;
+        char *name = e;
+        size_t name_len = strlen(name);
+        e += name_len + 1;
+
+        if (!match_pattern(comp->wp, name, name_len)) {
+            continue;
+        }
+
+        size_t len = append(pw, path_len, name, name_len, 0);
+        if (len == 0) {
+            continue;
+        }
+        if (need_dir) {
+            // Links and file systems not reporting types need a closer look
+            if (type != DT_DIR) {
+                struct stat st;
+                if (type != DT_LNK && type != DT_UNKNOWN) {
+                    continue;
+                }
+                if (stat(pw->path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+                    continue;
+                }
+            }
+            len = append(pw, len, "/", 1, 0);
+        }
+        res = last ? emit(pw, len) : walk(pw, len, ci + 1);
+    }
+
+    if (owned) {
+        free_listing(dl);
+    }
+    return res;
+
+}
+
+
+// Hands a complete path to the visitor
+static int emit(path_walk *pw, size_t path_len) {
+
+    pw->path[path_len] = '\0';
+    pw->found++;
+    return pw->visit(pw->ctx, pw->path, path_len);
+
+}
+
+
+// Appends len characters of s to the first path_len characters of the path
+// and returns the new length, or 0 if the path would be too long
+static size_t append(path_walk *pw, size_t path_len, const char *s,
+                     size_t len, int unescape) {
+
+    for (size_t i = 0; i < len; ++i) {
+        if (unescape && s[i] == '\\' && i + 1 < len) {
+            i++;
+        }
+        if (path_len + 1 >= PATH_MAX) {
+            return 0;
+        }
+        pw->path[path_len++] = s[i];
+    }
+    pw->path[path_len] = '\0';
+    return path_len;
+
+}
+
+
+// Returns the listing of a directory, from the cache if it has not been
+// modified since. If the listing did not fit in the cache, *owned is set
+// and the caller frees it
+static dir_listing *list_dir(const char *path, int *owned) {
+
+    struct stat st;
+    for (size_t i = 0; i < dir_cache_count; ++i) {
+        dir_listing *dl = dir_cache[i];
+        if (strcmp(dl->path, path)) {
+            continue;
+        }
+        if (stat(path, &st) == 0 && st.st_dev == dl->dev &&
+            st.st_ino == dl->ino &&
+            st.st_mtim.tv_sec == dl->mtime.tv_sec &&
+            st.st_mtim.tv_nsec == dl->mtime.tv_nsec) {
+            *owned = 0;
+            return dl;
+        }
+        // Stale: replace it
+        free_listing(dl);
+        dir_cache[i] = dir_cache[--dir_cache_count];
+        break;
+    }
+
+    dir_listing *dl = read_dir(path);
+    if (dl == NULL) {
+        return NULL;
+    }
+
+    *owned = dir_cache_count == DIR_CACHE_SIZE;
+    if (!*owned) {
+        dir_cache[dir_cache_count++] = dl;
+    }
+    return dl;
+
+}
+
+
+// Reads all names in a directory, many directory entries per system call
+static dir_listing *read_dir(const char *path) {
+
+    if (dents_buf == NULL && (dents_buf = malloc(DENTS_BUF_SIZE)) == NULL) {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    dir_listing *dl = calloc(1, sizeof(dir_listing));
+    if (dl == NULL || fstat(fd, &st) < 0 || (dl->path = strdup(path)) == NULL) {
+        free(dl);
+        close(fd);
+        return NULL;
+    }
+    dl->dev = st.st_dev;
+    dl->ino = st.st_ino;
+    dl->mtime = st.st_mtim;
+
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, dents_buf, DENTS_BUF_SIZE)) > 0) {
+        for (long pos = 0; pos < n; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (dents_buf + pos);
+            pos += d->d_reclen;
+
+            char *name = d->d_name;
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) {
+                continue;
+            }
+
+            size_t len = strlen(name) + 2; // Type byte and terminator
+            if (dl->len + len > dl->size) {
+                size_t size = dl->size ? 2 * dl->size : 4096;
+                while (size < dl->len + len) {
+                    size *= 2;
+                }
+                char *grown = realloc(dl->names, size);
+                if (grown == NULL) {
+                    close(fd);
+                    free_listing(dl);
+                    return NULL;
+                }
+                dl->names = grown;
+                dl->size = size;
+            }
+            dl->names[dl->len] = d->d_type;
+            memcpy(dl->names + dl->len + 1, name, len - 1);
+            dl->len += len;
+        }
+    }
+
+    close(fd);
+    // A listing cut short would make words match too few names
+    if (n < 0) {
+        free_listing(dl);
+        return NULL;
+    }
+    return dl;
+
+}
+
+
+static void free_listing(dir_listing *dl) {
+
+    free(dl->path);
+    free(dl->names);
+    free(dl);
+
+}
@@ -0,0 +1,44 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include <stddef.h>
+#include <limits.h>
+
+#define is_wild(c)      ((c) == '*' || (c) == '?' || (c) == '[')
+
+#define DIR_CACHE_SIZE  64          // Directory listings kept during a line
+#define DENTS_BUF_SIZE  (1 << 17)   // Bytes asked for per getdents64 call
+
+// The steps a compiled pattern is made of
+enum pattern_op {
+    OP_CHAR,  // arg is the character
+    OP_ANY,   // ?
+    OP_STAR,  // *
+    OP_CLASS  // [...], arg is the index of the class
+};
+
+// A pattern for a single path component, compiled once
+// and then matched against every name in a directory
+typedef struct wp {
+    struct {
+        unsigned char type;
+        unsigned char arg;
+    } ops[NAME_MAX + 1];
+    size_t op_count;
+    unsigned char classes[NAME_MAX / 2 + 1][32]; // Bitmaps of accepted chars
+    size_t class_count;
+    size_t min_len;   // Shortest name that can match
+    int dot_ok;       // Whether a leading dot can be matched
+} wildcard_pattern;
+
+// Receives each path a word expands to. The path is only valid during
+// the call. Returning a negative value stops the expansion
+typedef int (*wildcard_visit)(void *ctx, const char *path, size_t len);
+
+int has_wildcards(const char *word);
+int compile_pattern(const char *pat, size_t len, wildcard_pattern *wp);
+int match_pattern(const wildcard_pattern *wp, const char *name, size_t len);
+int expand_wildcards(const char *word, wildcard_visit visit, void *ctx);
+void clear_dir_cache();
+
+#endif
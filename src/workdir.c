@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "vars.h"
+#include "workdir.h"
+
+// The logical working directory, the path cd was given rather than the one
+// the kernel would give, and the prompt made from it. Both only change
+// with cd, so reading a line costs no system call for them
+static struct {
+    char path[PATH_MAX];
+    char prompt[PATH_MAX + sizeof(PROMPT_END)];
+} wd = { "", PROMPT_END };
+
+static void set_work_dir(const char *path);
+
+
+// Takes the working directory from $PWD if that names the directory the
+// shell started in, which keeps the path a parent shell used through
+// symbolic links, and asks for it otherwise. If neither works, as in a
+// directory since removed, the prompt has no path until cd is used
+void init_work_dir() {
+
+    char path[PATH_MAX];
+    const char *pwd = get_var("PWD");
+    struct stat given, actual;
+
+    if (pwd && *pwd == '/' && resolve_path("/", pwd, path, PATH_MAX) == 0 &&
+        !strcmp(path, pwd) && stat(pwd, &given) == 0 &&
+        stat(".", &actual) == 0 && given.st_dev == actual.st_dev &&
+        given.st_ino == actual.st_ino) {
+        set_work_dir(pwd);
+    } else if (getcwd(path, PATH_MAX) != NULL) {
+        set_work_dir(path);
+    }
+
+}
+
+
+const char *get_work_dir() {
+
+    return wd.path;
+
+}
+
+
+// Returns the prompt, the working directory followed by PROMPT_END
+const char *get_prompt() {
+
+    return wd.prompt;
+
+}
+
+
+// Changes the working directory. A relative path is taken from the logical
+// working directory, so .. leaves a symbolic link the way it was entered.
+// $PWD and $OLDPWD follow. Returns -1 if the directory cannot be entered
+int change_dir(const char *path) {
+
+    char target[PATH_MAX];
+
+    // Without a known working directory there is no logical path to take
+    // a relative one from
+    if (*path != '/' && *wd.path == '\0') {
+        if (chdir(path) < 0) {
+            return -1;
+        }
+        init_work_dir();
+        return 0;
+    }
+
+    if (resolve_path(wd.path, path, target, PATH_MAX) < 0 ||
+        chdir(target) < 0) {
+        return -1;
+    }
+    if (*wd.path != '\0') {
+        set_var("OLDPWD", 6, wd.path, 1);
+    }
+    set_work_dir(target);
+    return 0;
+
+}
+
+
+// Joins path to the directory base unless it is absolute, and removes
+// . and .. components and repeated slashes without looking at the file
+// system, so .. removes the component before it even if that is a
+// symbolic link. Returns -1 if the result does not fit in size bytes
+int resolve_path(const char *base, const char *path, char *out, size_t size) {
+
+    size_t len = 0;
+
+    for (int part = *path == '/'; part < 2; ++part) {
+        const char *c = part == 0 ? base : path;
+        while (*c != '\0') {
+            while (*c == '/') {
+                c++;
+            }
+            size_t n = strcspn(c, "/");
+            if (n == 0 || (n == 1 && c[0] == '.')) {
+                ; // Stays in the same directory
+            } else if (n == 2 && c[0] == '.' && c[1] == '.') {
+                while (len > 0 && out[--len] != '/') {
+                    ;
+                }
+            } else {
+                if (len + n + 2 > size) {
+                    return -1;
+                }
+                out[len++] = '/';
+                memcpy(out + len, c, n);
+                len += n;
+            }
+            c += n;
+        }
+    }
+
+    if (len + (len == 0) + 1 > size) {
+        return -1;
+    }
+    if (len == 0) {
+        out[len++] = '/';
+    }
+    out[len] = '\0';
+    return 0;
+
+}
+
+
+// Keeps a new working directory, shorter than PATH_MAX, its prompt
+// and $PWD
+static void set_work_dir(const char *path) {
+
+    size_t len = strlen(path);
+    memcpy(wd.path, path, len + 1);
+    memcpy(wd.prompt, path, len);
+    memcpy(wd.prompt + len, PROMPT_END, sizeof(PROMPT_END));
+    set_var("PWD", 3, path, 1);
+
+}
@@ -0,0 +1,14 @@
+#ifndef WORKDIR_H
+#define WORKDIR_H
+
+#include <stddef.h>
+
+#define PROMPT_END "> " // After the working directory in the prompt
+
+void init_work_dir();
+const char *get_work_dir();
+const char *get_prompt();
+int change_dir(const char *path);
+int resolve_path(const char *base, const char *path, char *out, size_t size);
+
+#endif
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "rlimits.h"
+#include "vars.h"
+#include "zygote.h"
+
+extern char **environ;
+
+// Zygotes are processes started ahead of time that wait to become a
+// command. Each is a fresh exec of the shell binary that stops right at
+// the start of main, so it holds next to no memory of its own. The shell
+// keeps a socket to each, over which it sends the arguments, environment
+// and limits of a command together with the file descriptors it should
+// use. Taking a zygote is a single sendmsg, so no fork is in the way
+// between reading a command and starting it.
+// Spawning a zygote waits for its exec, which takes about as long as
+// forking the command would have, so used ones are replaced by a thread
+// of their own while the shell goes on to the next line
+static struct {
+    pid_t pid;
+    int sock;
+} pool[ZYGOTE_MAX];
+
+static size_t pool_count;
+static size_t pool_target;
+static int refill_wanted;  // Cleared when a zygote fails to start
+static int refilling;      // The refill thread is running
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_low = PTHREAD_COND_INITIALIZER;
+// Zygotes are children of the first process to ask for them only, so a
+// child forked while the refill thread held the lock never takes it
+static pid_t owner;
+
+static char msg_buf[ZYGOTE_MSG_MAX];
+
+static void *refill_thread(void *arg);
+static int start_zygote(pid_t *pid, int *sock);
+static void stop_zygote(pid_t pid, int sock);
+static size_t build_msg(char **argv, const job_limits *limits);
+
+
+// Runs a zygote: waits on the control socket for a command and then
+// becomes it. Exits without doing anything when the shell goes away
+void zygote_main(int sock) {
+
+    // Only the command it becomes should be interrupted from the terminal
+    signal(SIGINT, SIG_IGN);
+
+    int fds[ZYGOTE_FDS];
+    // A union, so the buffer is aligned for the header that starts it
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { msg_buf, sizeof(msg_buf) };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    ssize_t len = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    if (len < (ssize_t) sizeof(zygote_msg) || cm == NULL ||
+        cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        _exit(EXIT_SUCCESS);
+    }
+    memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+    zygote_msg zm;
+    memcpy(&zm, msg_buf, sizeof(zm));
+    char *argv[zm.argc + 1];
+    char *envp[zm.envc + 1];
+    char *s = msg_buf + sizeof(zm);
+    char *end = msg_buf + len;
+
+    for (uint32_t i = 0; i < zm.argc + zm.envc; ++i) {
+        char *nul = memchr(s, '\0', end - s);
+        if (nul == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+        if (i < zm.argc) {
+            argv[i] = s;
+        } else {
+            envp[i - zm.argc] = s;
+        }
+        s = nul + 1;
+    }
+    argv[zm.argc] = NULL;
+    envp[zm.envc] = NULL;
+
+    for (int fd = 0; fd < 3; ++fd) {
+        dup2(fds[fd], fd);
+    }
+    if (fchdir(fds[3]) < 0) {
+        _exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ZYGOTE_FDS; ++i) {
+        close(fds[i]);
+    }
+    close(sock);
+
+    if (apply_limits(&zm.limits) < 0) {
+        _exit(EXIT_FAILURE);
+    }
+    signal(SIGINT, SIG_DFL);
+    environ = envp;
+    execvp(argv[0], argv);
+
+    fprintf(stderr, "Unknown or malformatted command: %s\n", argv[0]);
+    _exit(EXIT_FAILURE);
+
+}
+
+
+// Sets how many zygotes to keep waiting, stopping some or having the
+// refill thread start more
+void set_zygote_count(size_t count) {
+
+    if (count > ZYGOTE_MAX) {
+        count = ZYGOTE_MAX;
+    }
+    if (owner == 0) {
+        owner = getpid();
+    }
+    if (owner != getpid()) {
+        return;
+    }
+
+    if (count > 0 && !refilling) {
+        // Signals are for the main thread to handle
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+
+        pthread_t thread;
+        refilling = pthread_create(&thread, NULL, refill_thread, NULL) == 0;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (!refilling) {
+            return;
+        }
+        pthread_detach(thread);
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    pool_target = count;
+    size_t stopped = pool_count > count ? pool_count - count : 0;
+    pool_count -= stopped;
+    pthread_mutex_unlock(&pool_lock);
+
+    // The refill thread only adds zygotes below the target, so the ones
+    // past it are left alone
+    for (size_t i = 0; i < stopped; ++i) {
+        stop_zygote(pool[pool_count + i].pid, pool[pool_count + i].sock);
+    }
+    refill_zygotes();
+
+}
+
+
+// Has the refill thread start zygotes until there are as many as wanted.
+// Called once a job is done, and returns right away
+void refill_zygotes() {
+
+    if (owner != getpid() || !refilling) {
+        return;
+    }
+    pthread_mutex_lock(&pool_lock);
+    refill_wanted = 1;
+    pthread_cond_signal(&pool_low);
+    pthread_mutex_unlock(&pool_lock);
+
+}
+
+
+// Checks if the calling process has a zygote to hand a command to
+int zygotes_waiting() {
+
+    if (owner != getpid()) {
+        return 0;
+    }
+    pthread_mutex_lock(&pool_lock);
+    int waiting = pool_count > 0;
+    pthread_mutex_unlock(&pool_lock);
+    return waiting;
+
+}
+
+
+// Hands a command to a waiting zygote, which makes fds[0] to fds[2] its
+// stdin, stdout and stderr, changes to the directory fds[3] refers to,
+// applies the limits and execs the command with the exported variables.
+// Returns the pid the command runs as, or -1 if no zygote could take it
+// and the caller has to fork
+pid_t zygote_exec(char **argv, const int fds[ZYGOTE_FDS],
+                  const job_limits *limits) {
+
+    if (!zygotes_waiting()) {
+        return -1;
+    }
+    size_t len = build_msg(argv, limits);
+    if (len == 0) {
+        return -1;
+    }
+
+    union {
+        char buf[CMSG_SPACE(ZYGOTE_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(control.buf, 0, sizeof(control.buf));
+    struct iovec iov = { msg_buf, len };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(ZYGOTE_FDS * sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, ZYGOTE_FDS * sizeof(int));
+
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        if (pool_count == 0) {
+            pthread_mutex_unlock(&pool_lock);
+            return -1;
+        }
+        pool_count--;
+        pid_t pid = pool[pool_count].pid;
+        int sock = pool[pool_count].sock;
+        pthread_mutex_unlock(&pool_lock);
+
+        ssize_t sent = sendmsg(sock, &mh, MSG_NOSIGNAL);
+        close(sock);
+        if (sent == (ssize_t) len) {
+            return pid;
+        }
+        // That zygote is gone, or will be once it sees the socket closed
+        waitpid(pid, NULL, 0);
+    }
+
+}
+
+
+// Starts zygotes whenever there are fewer than wanted. The lock is not
+// held while one starts, so the shell can take the ones already waiting
+static void *refill_thread(void *arg) {
+
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (!refill_wanted || pool_count >= pool_target) {
+            pthread_cond_wait(&pool_low, &pool_lock);
+        }
+        pthread_mutex_unlock(&pool_lock);
+
+        pid_t pid;
+        int sock;
+        int res = start_zygote(&pid, &sock);
+
+        pthread_mutex_lock(&pool_lock);
+        if (res < 0) {
+            // Tried again after the next job rather than over and over
+            refill_wanted = 0;
+        } else if (pool_count < pool_target) {
+            pool[pool_count].pid = pid;
+            pool[pool_count].sock = sock;
+            pool_count++;
+        } else {
+            // Fewer were asked for while it started
+            pthread_mutex_unlock(&pool_lock);
+            stop_zygote(pid, sock);
+            pthread_mutex_lock(&pool_lock);
+        }
+    }
+    return NULL;
+
+}
+
+
+static int start_zygote(pid_t *pid, int *sock) {
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        return -1;
+    }
+    // Duplicating onto itself would leave close-on-exec set
+    if (sv[1] == ZYGOTE_FD) {
+        int fd = fcntl(sv[1], F_DUPFD_CLOEXEC, ZYGOTE_FD + 1);
+        close(sv[1]);
+        sv[1] = fd;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], ZYGOTE_FD);
+
+    // The environment is sent with each command
+    char *argv[] = { "bunsh", ZYGOTE_ARG, NULL };
+    char *envp[] = { NULL };
+    int res = sv[1] == -1 ? -1 : posix_spawn(pid, "/proc/self/exe",
+                                             &actions, NULL, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    close(sv[1]);
+
+    if (res != 0) {
+        close(sv[0]);
+        return -1;
+    }
+    *sock = sv[0];
+    return 0;
+
+}
+
+
+static void stop_zygote(pid_t pid, int sock) {
+
+    close(sock);
+    waitpid(pid, NULL, 0);
+
+}
+
+
+// Puts a command in the message buffer. Returns its length, or 0 if it
+// does not fit
+static size_t build_msg(char **argv, const job_limits *limits) {
+
+    zygote_msg zm = { 0, 0, *limits };
+    char **envp = get_envp();
+    size_t pos = sizeof(zm);
+
+    for (char **s = argv; *s; ++s, ++zm.argc) {
+        size_t len = strlen(*s) + 1;
+        if (pos + len > sizeof(msg_buf)) {
+            return 0;
+        }
+        memcpy(msg_buf + pos, *s, len);
+        pos += len;
+    }
+    for (char **s = envp; s && *s; ++s, ++zm.envc) {
+        size_t len = strlen(*s) + 1;
+        if (pos + len > sizeof(msg_buf)) {
+            return 0;
+        }
+        memcpy(msg_buf + pos, *s, len);
+        pos += len;
+    }
+
+    memcpy(msg_buf, &zm, sizeof(zm));
+    return pos;
+
+}
@@ -0,0 +1,30 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "rlimits.h"
+
+#define ZYGOTE_ARG     "--zygote"      // Makes bunsh start as a zygote
+#define ZYGOTE_FD      3               // Where a zygote finds its socket
+#define ZYGOTE_VAR     "BUNSH_ZYGOTES" // How many zygotes to keep waiting
+#define ZYGOTE_MAX     64
+#define ZYGOTE_FDS     4               // stdin, stdout, stderr and cwd
+#define ZYGOTE_MSG_MAX (1 << 16)       // Larger commands are forked instead
+
+// What a zygote is told to run. The arguments and then the environment
+// follow, each string null terminated
+typedef struct zm {
+    uint32_t argc;
+    uint32_t envc;
+    job_limits limits;
+} zygote_msg;
+
+void zygote_main(int sock);
+void set_zygote_count(size_t count);
+void refill_zygotes();
+int zygotes_waiting();
+pid_t zygote_exec(char **argv, const int fds[ZYGOTE_FDS],
+                  const job_limits *limits);
+
+#endif
@@ -2,6 +2,11 @@
 #include "CUnit/Basic.h"
 #include "src/parser.h"
 #include "test/parser_suite.h"
+#include "test/wildcard_suite.h"
+#include "test/vars_suite.h"
+#include "test/stored_suite.h"
+#include "test/workdir_suite.h"
+#include "test/histfile_suite.h"
 
 int main() {
 
@@ -25,6 +30,8 @@ int main() {
                      test_determine_size_deep) ||
         !CU_add_test(pSuite_parser, "determine_size, varying item length",
                      test_determine_size_varying_item_whitespace_length) ||
+        !CU_add_test(pSuite_parser, "determine_size, quoted",
+                     test_determine_size_quoted) ||
         !CU_add_test(pSuite_parser, "parse_spec, rejecting state",
                      test_parse_spec_rejecting_state) ||
         !CU_add_test(pSuite_parser, "parse_spec, pipe",
@@ -47,6 +54,20 @@ int main() {
                      test_lexer_spec) ||
         !CU_add_test(pSuite_parser, "lexer, spec after id",
                      test_lexer_spec_after_id) ||
+        !CU_add_test(pSuite_parser, "lexer, trailing spaces",
+                     test_lexer_trailing_spaces) ||
+        !CU_add_test(pSuite_parser, "lexer, single quotes",
+                     test_lexer_single_quotes) ||
+        !CU_add_test(pSuite_parser, "lexer, double quotes and escapes",
+                     test_lexer_double_quotes_and_escapes) ||
+        !CU_add_test(pSuite_parser, "lexer, quoted spec",
+                     test_lexer_quoted_spec) ||
+        !CU_add_test(pSuite_parser, "lexer, dynamic kept as written",
+                     test_lexer_dynamic_kept_as_written) ||
+        !CU_add_test(pSuite_parser, "lexer, unterminated quote",
+                     test_lexer_unterminated_quote) ||
+        !CU_add_test(pSuite_parser, "lexer, here-document tokens",
+                     test_lexer_here_tokens) ||
         !CU_add_test(pSuite_parser, "get_spec, normal",
                      test_get_spec_normal) ||
         !CU_add_test(pSuite_parser, "get_spec, non-special char",
@@ -55,6 +76,119 @@ int main() {
         return CU_get_error();
     }
 
+    CU_pSuite pSuite_wildcard = NULL;
+    pSuite_wildcard = CU_add_suite("WILDCARD", NULL, NULL);
+
+    if (!pSuite_wildcard) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite_wildcard, "has_wildcards",
+                     test_has_wildcards) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, literal",
+                     test_match_pattern_literal) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, star",
+                     test_match_pattern_star) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, any",
+                     test_match_pattern_any) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, class",
+                     test_match_pattern_class) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, negated class",
+                     test_match_pattern_negated_class) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, hidden files",
+                     test_match_pattern_hidden) ||
+        !CU_add_test(pSuite_wildcard, "match_pattern, escape",
+                     test_match_pattern_escape)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_pSuite pSuite_vars = NULL;
+    pSuite_vars = CU_add_suite("VARS", init_suite_vars, NULL);
+
+    if (!pSuite_vars) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite_vars, "set_var and get_var",
+                     test_set_and_get_var) ||
+        !CU_add_test(pSuite_vars, "unset_var",
+                     test_unset_var) ||
+        !CU_add_test(pSuite_vars, "is_assignment",
+                     test_is_assignment) ||
+        !CU_add_test(pSuite_vars, "get_envp, rebuilt on export only",
+                     test_envp_rebuilt_on_export_only) ||
+        !CU_add_test(pSuite_vars, "table growth",
+                     test_var_table_growth) ||
+        !CU_add_test(pSuite_vars, "expansion, unquoted values split",
+                     test_unquoted_values_split)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_pSuite pSuite_stored = NULL;
+    pSuite_stored = CU_add_suite("STORED", init_suite_stored, NULL);
+
+    if (!pSuite_stored) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite_stored, "store_line and load_line",
+                     test_store_and_load_line) ||
+        !CU_add_test(pSuite_stored, "load_line, items in stored line",
+                     test_loaded_items_point_into_stored_line) ||
+        !CU_add_test(pSuite_stored, "stored line, copied elsewhere",
+                     test_stored_line_copied_elsewhere) ||
+        !CU_add_test(pSuite_stored, "stored line, accessors",
+                     test_stored_accessors)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_pSuite pSuite_workdir = NULL;
+    pSuite_workdir = CU_add_suite("WORKDIR", NULL, NULL);
+
+    if (!pSuite_workdir) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite_workdir, "resolve_path, relative",
+                     test_resolve_relative_path) ||
+        !CU_add_test(pSuite_workdir, "resolve_path, absolute",
+                     test_resolve_absolute_path) ||
+        !CU_add_test(pSuite_workdir, "resolve_path, too long",
+                     test_resolve_path_too_long)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_pSuite pSuite_histfile = NULL;
+    pSuite_histfile = CU_add_suite("HISTFILE", init_suite_histfile,
+                                   clean_suite_histfile);
+
+    if (!pSuite_histfile) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite_histfile, "hist_append and hist_tail",
+                     test_hist_append_and_tail) ||
+        !CU_add_test(pSuite_histfile, "hist_search, prefix and substring",
+                     test_hist_search) ||
+        !CU_add_test(pSuite_histfile, "entry of several lines",
+                     test_hist_multi_line_entry) ||
+        !CU_add_test(pSuite_histfile, "reopened file",
+                     test_hist_reopen) ||
+        !CU_add_test(pSuite_histfile, "concurrent appends",
+                     test_hist_concurrent_appends)) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();
     CU_cleanup_registry();
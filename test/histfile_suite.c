@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "CUnit/Basic.h"
+#include "src/histfile.h"
+
+#define MAX_SEEN 4096
+
+static char path[] = "/tmp/bunsh_hist_test_XXXXXX";
+static char *seen[MAX_SEEN]; // Entries passed to the visitor, in order
+static size_t seen_num[MAX_SEEN];
+static size_t seen_count;
+
+int init_suite_histfile() {
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    return hist_open(path);
+}
+
+int clean_suite_histfile() {
+    hist_close();
+    return unlink(path);
+}
+
+static void forget_seen() {
+    for (size_t i = 0; i < seen_count; ++i) {
+        free(seen[i]);
+    }
+    seen_count = 0;
+}
+
+static void visit(size_t num, const char *entry, size_t len) {
+    if (seen_count < MAX_SEEN) {
+        seen_num[seen_count] = num;
+        seen[seen_count++] = strndup(entry, len);
+    }
+}
+
+static void load(const char *entry) {
+    visit(0, entry, strlen(entry));
+}
+
+void test_hist_append_and_tail() {
+    CU_ASSERT_EQUAL(hist_append("one"), 0);
+    CU_ASSERT_EQUAL(hist_append("two"), 0);
+    CU_ASSERT_EQUAL(hist_append("three"), 0);
+
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_tail(2, visit), 2);
+    CU_ASSERT_EQUAL_FATAL(seen_count, 2);
+    CU_ASSERT_STRING_EQUAL(seen[0], "two");
+    CU_ASSERT_EQUAL(seen_num[0], 2);
+    CU_ASSERT_STRING_EQUAL(seen[1], "three");
+    CU_ASSERT_EQUAL(seen_num[1], 3);
+
+    // More than there are gives all of them
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_tail(100, visit), 3);
+}
+
+void test_hist_search() {
+    hist_append("git commit");
+    hist_append("make");
+    hist_append("git push");
+    hist_append("echo git");
+
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_search(MATCH_PREFIX, "git", visit), 2);
+    CU_ASSERT_EQUAL_FATAL(seen_count, 2);
+    CU_ASSERT_STRING_EQUAL(seen[0], "git commit");
+    CU_ASSERT_STRING_EQUAL(seen[1], "git push");
+
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_search(MATCH_SUBSTRING, "git", visit), 3);
+    CU_ASSERT_EQUAL_FATAL(seen_count, 3);
+    CU_ASSERT_STRING_EQUAL(seen[2], "echo git");
+
+    // The sorted order is extended by entries added after a search
+    hist_append("git status");
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_search(MATCH_PREFIX, "git ", visit), 3);
+
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_search(MATCH_SUBSTRING, "not there", visit), 0);
+}
+
+void test_hist_multi_line_entry() {
+    hist_append("for x in a b; do\necho $x\ndone");
+
+    forget_seen();
+    hist_tail(1, visit);
+    CU_ASSERT_EQUAL_FATAL(seen_count, 1);
+    CU_ASSERT_PTR_NULL(strchr(seen[0], '\n'));
+    CU_ASSERT_PTR_NOT_NULL(strchr(seen[0], HIST_NEWLINE));
+
+    // Readline gets the lines back
+    forget_seen();
+    hist_load_recent(1, load);
+    CU_ASSERT_EQUAL_FATAL(seen_count, 1);
+    CU_ASSERT_STRING_EQUAL(seen[0], "for x in a b; do\necho $x\ndone");
+}
+
+void test_hist_reopen() {
+    forget_seen();
+    size_t before = hist_tail(MAX_SEEN, visit);
+    hist_close();
+    CU_ASSERT_EQUAL_FATAL(hist_open(path), 0);
+
+    forget_seen();
+    CU_ASSERT_EQUAL(hist_tail(MAX_SEEN, visit), before);
+    CU_ASSERT_STRING_EQUAL(seen[0], "one");
+}
+
+void test_hist_concurrent_appends() {
+    enum { SESSIONS = 4, LINES = 200 };
+
+    forget_seen();
+    size_t before = hist_tail(MAX_SEEN, visit);
+
+    // Each session opens the file itself, as separate shells do
+    for (int s = 0; s < SESSIONS; ++s) {
+        if (fork() == 0) {
+            hist_close();
+            if (hist_open(path) < 0) {
+                _exit(1);
+            }
+            char line[64];
+            for (int i = 0; i < LINES; ++i) {
+                snprintf(line, sizeof(line), "session %d line %d", s, i);
+                hist_append(line);
+            }
+            _exit(0);
+        }
+    }
+    int status;
+    while (wait(&status) > 0) {
+        CU_ASSERT_EQUAL(status, 0);
+    }
+
+    forget_seen();
+    CU_ASSERT_EQUAL_FATAL(hist_tail(MAX_SEEN, visit),
+                          before + SESSIONS * LINES);
+    int intact = 1;
+    int next[SESSIONS] = { 0 };
+    for (size_t i = before; i < seen_count; ++i) {
+        int s, n;
+        char end;
+        if (sscanf(seen[i], "session %d line %d%c", &s, &n, &end) != 2 ||
+            s < 0 || s >= SESSIONS || n != next[s]++) {
+            intact = 0;
+        }
+    }
+    CU_ASSERT_TRUE(intact);
+    forget_seen();
+}
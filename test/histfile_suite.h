@@ -0,0 +1,16 @@
+#ifndef HISTFILE_SUITE_H
+#define HISTFILE_SUITE_H
+
+#include "CUnit/Basic.h"
+#include "src/histfile.h"
+
+int init_suite_histfile();
+int clean_suite_histfile();
+
+void test_hist_append_and_tail();
+void test_hist_search();
+void test_hist_multi_line_entry();
+void test_hist_reopen();
+void test_hist_concurrent_appends();
+
+#endif
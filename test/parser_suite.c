@@ -56,6 +56,14 @@ void test_determine_size_varying_item_whitespace_length() {
     CU_ASSERT_EQUAL(pipe_count, 5);
 }
 
+void test_determine_size_quoted() {
+    reset_fixtures();
+    char *line = "a 'b | c' \"d e\"|f\\ g";
+    determine_size(line, &item_count, &pipe_count);
+    CU_ASSERT_EQUAL(item_count, 4);
+    CU_ASSERT_EQUAL(pipe_count, 1);
+}
+
 void test_parse_spec_rejecting_state() {
     reset_fixtures();
     pl.state = CMD_EXPECTED;
@@ -162,6 +170,79 @@ void test_lexer_spec_after_id() {
     CU_ASSERT_EQUAL(lex.has_next, 0);
 }
 
+void test_lexer_trailing_spaces() {
+    reset_fixtures();
+    char line[] = "z   ";
+    init_lexer(&lex, line);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "z");
+    CU_ASSERT_EQUAL(lex.has_next, 0);
+}
+
+void test_lexer_single_quotes() {
+    reset_fixtures();
+    char line[] = "'a  b'c d";
+    init_lexer(&lex, line);
+    char *tok = next_tok(&lex);
+    CU_ASSERT_STRING_EQUAL(tok, "a  bc");
+    // Unquoted in place
+    CU_ASSERT_PTR_EQUAL(tok, line);
+    CU_ASSERT_EQUAL(lex.flags, WORD_QUOTED);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "d");
+    CU_ASSERT_EQUAL(lex.has_next, 0);
+}
+
+void test_lexer_double_quotes_and_escapes() {
+    reset_fixtures();
+    char line[] = "\"x\\\"y\\z\" a\\ b";
+    init_lexer(&lex, line);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "x\"y\\z");
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "a b");
+    CU_ASSERT_EQUAL(lex.has_next, 0);
+}
+
+void test_lexer_quoted_spec() {
+    reset_fixtures();
+    char line[] = "'|'\\&\"<\">";
+    init_lexer(&lex, line);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "|&<");
+    CU_ASSERT_EQUAL(lex.flags, WORD_QUOTED);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), ">");
+    CU_ASSERT_EQUAL(lex.flags, 0);
+}
+
+void test_lexer_dynamic_kept_as_written() {
+    reset_fixtures();
+    char line[] = "\"$X\"'*'|";
+    init_lexer(&lex, line);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "\"$X\"'*'");
+    CU_ASSERT_EQUAL(lex.flags, WORD_QUOTED|WORD_DYNAMIC);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "|");
+}
+
+void test_lexer_unterminated_quote() {
+    reset_fixtures();
+    char line[] = "a \"b c";
+    init_lexer(&lex, line);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "a");
+    CU_ASSERT_PTR_NULL(next_tok(&lex));
+    CU_ASSERT_TRUE(lex.flags & WORD_OPEN);
+    CU_ASSERT_EQUAL(lex.has_next, 0);
+}
+
+void test_lexer_here_tokens() {
+    reset_fixtures();
+    char line[] = "cat<<EOF <<< word <";
+    init_lexer(&lex, line);
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "cat");
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "<<");
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "EOF");
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "<<<");
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "word");
+    CU_ASSERT_STRING_EQUAL(next_tok(&lex), "<");
+    CU_ASSERT_FALSE(lex.has_next);
+}
+
+
 void test_get_spec_normal() {
     reset_fixtures();
     const char expected[] = { '|', '\0' };
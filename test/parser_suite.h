@@ -11,6 +11,7 @@ void test_determine_size_empty();
 void test_determine_size_only_whitespace();
 void test_determine_size_deep();
 void test_determine_size_varying_item_whitespace_length();
+void test_determine_size_quoted();
 void test_parse_spec_rejecting_state();
 void test_parse_spec_pipe();
 void test_parse_spec_rdin_legal();
@@ -22,6 +23,13 @@ void test_lexer_empty_string();
 void test_lexer_leading_spaces();
 void test_lexer_spec();
 void test_lexer_spec_after_id();
+void test_lexer_trailing_spaces();
+void test_lexer_single_quotes();
+void test_lexer_double_quotes_and_escapes();
+void test_lexer_quoted_spec();
+void test_lexer_dynamic_kept_as_written();
+void test_lexer_unterminated_quote();
+void test_lexer_here_tokens();
 void test_get_spec_normal();
 void test_get_spec_non_special_token();
 
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "src/parser.h"
+#include "src/buffers.h"
+#include "src/stored.h"
+
+static parsed_line spl;
+
+int init_suite_stored() {
+    return init_buffers(&spl);
+}
+
+static stored_line *lex_and_store(const char *text) {
+    static char line[256];
+    strcpy(line, text);
+    if (parse_raw(line, &spl) < 0) {
+        return NULL;
+    }
+    stored_line *sl = store_line(&spl);
+    // Nothing may point into the line once it is stored
+    memset(line, 'x', sizeof(line));
+    return sl;
+}
+
+void test_store_and_load_line() {
+    stored_line *sl = lex_and_store("a 'b c' | d $X > out &");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sl);
+    CU_ASSERT_EQUAL(sl->cmd_count, 2);
+    CU_ASSERT_EQUAL(sl->item_count, 4);
+
+    CU_ASSERT_EQUAL(load_line(sl, &spl), 0);
+    CU_ASSERT_EQUAL(spl.pipe_count, 1);
+    CU_ASSERT_EQUAL(spl.background, 1);
+    CU_ASSERT_STRING_EQUAL(spl.rstdout, "out");
+    CU_ASSERT_PTR_NULL(spl.rstdin);
+
+    // Last command first, as the lexer leaves it
+    command *last = spl.cmd;
+    CU_ASSERT_EQUAL(last->length, 2);
+    CU_ASSERT_STRING_EQUAL(last->items[0], "d");
+    CU_ASSERT_STRING_EQUAL(last->items[1], "$X");
+    CU_ASSERT_PTR_NULL(last->items[2]);
+    CU_ASSERT_EQUAL(spl.item_buf->flags[last->items - spl.item_buf->start + 1],
+                    WORD_DYNAMIC);
+
+    command *first = last->next;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(first);
+    CU_ASSERT_PTR_NULL(first->next);
+    CU_ASSERT_EQUAL(first->pipe_depth, 0);
+    CU_ASSERT_STRING_EQUAL(first->items[1], "b c");
+    free(sl);
+}
+
+void test_loaded_items_point_into_stored_line() {
+    stored_line *sl = lex_and_store("echo one two");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sl);
+    load_line(sl, &spl);
+    for (char **item = spl.cmd->items; *item; ++item) {
+        CU_ASSERT_TRUE(*item > (char *) sl && *item < (char *) sl + sl->size);
+    }
+    free(sl);
+}
+
+void test_stored_line_copied_elsewhere() {
+    stored_line *sl = lex_and_store("cat < in | wc -l");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sl);
+    stored_line *moved = malloc(sl->size);
+    memcpy(moved, sl, sl->size);
+    free(sl);
+
+    CU_ASSERT_EQUAL(load_line(moved, &spl), 0);
+    CU_ASSERT_STRING_EQUAL(spl.rstdin, "in");
+    CU_ASSERT_STRING_EQUAL(spl.cmd->items[1], "-l");
+    CU_ASSERT_STRING_EQUAL(spl.cmd->next->items[0], "cat");
+    free(moved);
+}
+
+void test_stored_accessors() {
+    stored_line *sl = lex_and_store("a b | \"c\" | d e f");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sl);
+    CU_ASSERT_EQUAL(stored_length(sl, 0), 2);
+    CU_ASSERT_EQUAL(stored_length(sl, 1), 1);
+    CU_ASSERT_EQUAL(stored_length(sl, 2), 3);
+    CU_ASSERT_STRING_EQUAL(stored_item(sl, 2), "c");
+    CU_ASSERT_EQUAL(stored_flags(sl, 2), WORD_QUOTED);
+    CU_ASSERT_STRING_EQUAL(stored_item(sl, 5), "f");
+    free(sl);
+}
@@ -0,0 +1,16 @@
+#ifndef STORED_SUITE_H
+#define STORED_SUITE_H
+
+#include "CUnit/Basic.h"
+#include "src/parser.h"
+#include "src/buffers.h"
+#include "src/stored.h"
+
+int init_suite_stored();
+
+void test_store_and_load_line();
+void test_loaded_items_point_into_stored_line();
+void test_stored_line_copied_elsewhere();
+void test_stored_accessors();
+
+#endif
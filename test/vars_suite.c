@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "src/vars.h"
+#include "src/parser.h"
+#include "src/buffers.h"
+
+int init_suite_vars() {
+    char *env[] = { "HOME=/home/test", "EMPTY=", NULL };
+    return init_vars(env);
+}
+
+void test_set_and_get_var() {
+    CU_ASSERT_STRING_EQUAL(get_var("HOME"), "/home/test");
+    CU_ASSERT_STRING_EQUAL(get_var("EMPTY"), "");
+    CU_ASSERT_PTR_NULL(get_var("UNSET"));
+    set_var("NEW", 3, "value", 0);
+    CU_ASSERT_STRING_EQUAL(get_var("NEW"), "value");
+    CU_ASSERT_STRING_EQUAL(get_var_n("NEWER", 3), "value");
+    set_var("NEW", 3, "changed", 0);
+    CU_ASSERT_STRING_EQUAL(get_var("NEW"), "changed");
+}
+
+void test_unset_var() {
+    set_var("GONE", 4, "x", 0);
+    CU_ASSERT_EQUAL(unset_var("GONE"), 0);
+    CU_ASSERT_PTR_NULL(get_var("GONE"));
+    CU_ASSERT_EQUAL(unset_var("GONE"), -1);
+}
+
+void test_is_assignment() {
+    CU_ASSERT_EQUAL(is_assignment("A=1"), 1);
+    CU_ASSERT_EQUAL(is_assignment("_long_name2="), 11);
+    CU_ASSERT_EQUAL(is_assignment("2A=1"), 0);
+    CU_ASSERT_EQUAL(is_assignment("A-B=1"), 0);
+    CU_ASSERT_EQUAL(is_assignment("=1"), 0);
+    CU_ASSERT_EQUAL(is_assignment("plain"), 0);
+}
+
+void test_envp_rebuilt_on_export_only() {
+    char **envp = get_envp();
+    set_var("LOCAL", 5, "1", 0);
+    CU_ASSERT_PTR_EQUAL(get_envp(), envp);
+
+    export_var("LOCAL");
+    envp = get_envp();
+    int found = 0;
+    for (char **e = envp; *e; ++e) {
+        found |= !strcmp(*e, "LOCAL=1");
+    }
+    CU_ASSERT_TRUE(found);
+
+    set_var("HOME", 4, "/elsewhere", 0);
+    envp = get_envp();
+    found = 0;
+    for (char **e = envp; *e; ++e) {
+        found |= !strcmp(*e, "HOME=/elsewhere");
+    }
+    CU_ASSERT_TRUE(found);
+}
+
+void test_var_table_growth() {
+    char name[16];
+    for (int i = 0; i < 1000; ++i) {
+        int len = snprintf(name, sizeof(name), "V%d", i);
+        set_var(name, len, name, 0);
+    }
+    int all = 1;
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(name, sizeof(name), "V%d", i);
+        all &= get_var(name) && !strcmp(get_var(name), name);
+    }
+    CU_ASSERT_TRUE(all);
+}
+
+void test_unquoted_values_split() {
+    parsed_line pl;
+    CU_ASSERT_EQUAL_FATAL(init_buffers(&pl), 0);
+    set_var("LIST", 4, " a  b\tc ", 0);
+    set_var("NONE", 4, "", 0);
+
+    char line[] = "cmd $LIST \"$LIST\" x$LIST $NONE \"$NONE\"";
+    CU_ASSERT_EQUAL_FATAL(parse(line, &pl), 0);
+    char **items = pl.cmd->items;
+    const char *expected[] = {
+        "cmd", "a", "b", "c", " a  b\tc ", "x", "a", "b", "c", "", NULL
+    };
+    for (int i = 0; expected[i]; ++i) {
+        CU_ASSERT_PTR_NOT_NULL_FATAL(items[i]);
+        CU_ASSERT_STRING_EQUAL(items[i], expected[i]);
+    }
+    CU_ASSERT_PTR_NULL(items[10]);
+
+    free_buffers(&pl);
+}
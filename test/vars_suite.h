@@ -0,0 +1,16 @@
+#ifndef VARS_SUITE_H
+#define VARS_SUITE_H
+
+#include "CUnit/Basic.h"
+#include "src/vars.h"
+
+int init_suite_vars();
+
+void test_set_and_get_var();
+void test_unset_var();
+void test_is_assignment();
+void test_envp_rebuilt_on_export_only();
+void test_var_table_growth();
+void test_unquoted_values_split();
+
+#endif
@@ -0,0 +1,66 @@
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "src/wildcard.h"
+
+wildcard_pattern wp;
+
+int matches(const char *pat, const char *name) {
+    compile_pattern(pat, strlen(pat), &wp);
+    return match_pattern(&wp, name, strlen(name));
+}
+
+void test_has_wildcards() {
+    CU_ASSERT_FALSE(has_wildcards("plain/path"));
+    CU_ASSERT_TRUE(has_wildcards("dir/*.log"));
+    CU_ASSERT_TRUE(has_wildcards("file?"));
+    CU_ASSERT_TRUE(has_wildcards("[ab]"));
+    CU_ASSERT_FALSE(has_wildcards("escaped\\*"));
+}
+
+void test_match_pattern_literal() {
+    CU_ASSERT_TRUE(matches("abc", "abc"));
+    CU_ASSERT_FALSE(matches("abc", "abcd"));
+    CU_ASSERT_FALSE(matches("abc", "ab"));
+}
+
+void test_match_pattern_star() {
+    CU_ASSERT_TRUE(matches("*", "anything"));
+    CU_ASSERT_TRUE(matches("*.log", "x.log"));
+    CU_ASSERT_TRUE(matches("*.log", ".log.log") == 0);
+    CU_ASSERT_TRUE(matches("a*b*c", "aXXbYYbZc"));
+    CU_ASSERT_FALSE(matches("a*b*c", "aXXbYYbZ"));
+    CU_ASSERT_TRUE(matches("**x", "x"));
+}
+
+void test_match_pattern_any() {
+    CU_ASSERT_TRUE(matches("?.c", "a.c"));
+    CU_ASSERT_FALSE(matches("?.c", ".c"));
+    CU_ASSERT_FALSE(matches("??", "abc"));
+}
+
+void test_match_pattern_class() {
+    CU_ASSERT_TRUE(matches("[abc]1", "b1"));
+    CU_ASSERT_TRUE(matches("[a-c]1", "c1"));
+    CU_ASSERT_FALSE(matches("[a-c]1", "d1"));
+    CU_ASSERT_TRUE(matches("[]]", "]"));
+    CU_ASSERT_TRUE(matches("[a-]", "-"));
+    // An unterminated class is matched literally
+    CU_ASSERT_TRUE(matches("[ab", "[ab"));
+}
+
+void test_match_pattern_negated_class() {
+    CU_ASSERT_TRUE(matches("[!a-c]", "d"));
+    CU_ASSERT_FALSE(matches("[!a-c]", "a"));
+    CU_ASSERT_TRUE(matches("[^0-9]x", "ax"));
+}
+
+void test_match_pattern_hidden() {
+    CU_ASSERT_FALSE(matches("*", ".hidden"));
+    CU_ASSERT_FALSE(matches("?hidden", ".hidden"));
+    CU_ASSERT_TRUE(matches(".*", ".hidden"));
+}
+
+void test_match_pattern_escape() {
+    CU_ASSERT_TRUE(matches("a\\*", "a*"));
+    CU_ASSERT_FALSE(matches("a\\*", "ab"));
+}
@@ -0,0 +1,16 @@
+#ifndef WILDCARD_SUITE_H
+#define WILDCARD_SUITE_H
+
+#include "CUnit/Basic.h"
+#include "src/wildcard.h"
+
+void test_has_wildcards();
+void test_match_pattern_literal();
+void test_match_pattern_star();
+void test_match_pattern_any();
+void test_match_pattern_class();
+void test_match_pattern_negated_class();
+void test_match_pattern_hidden();
+void test_match_pattern_escape();
+
+#endif
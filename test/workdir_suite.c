@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "src/workdir.h"
+
+void test_resolve_relative_path() {
+    char out[64];
+    CU_ASSERT_EQUAL(resolve_path("/home/user", "src", out, sizeof(out)), 0);
+    CU_ASSERT_STRING_EQUAL(out, "/home/user/src");
+    resolve_path("/home/user", "..", out, sizeof(out));
+    CU_ASSERT_STRING_EQUAL(out, "/home");
+    resolve_path("/home/user", "./a//b/../c/", out, sizeof(out));
+    CU_ASSERT_STRING_EQUAL(out, "/home/user/a/c");
+    resolve_path("/home", "../../..", out, sizeof(out));
+    CU_ASSERT_STRING_EQUAL(out, "/");
+    resolve_path("/", ".", out, sizeof(out));
+    CU_ASSERT_STRING_EQUAL(out, "/");
+}
+
+void test_resolve_absolute_path() {
+    char out[64];
+    CU_ASSERT_EQUAL(resolve_path("/home/user", "/tmp/x/..", out,
+                                 sizeof(out)), 0);
+    CU_ASSERT_STRING_EQUAL(out, "/tmp");
+    resolve_path("/home/user", "//usr///lib", out, sizeof(out));
+    CU_ASSERT_STRING_EQUAL(out, "/usr/lib");
+}
+
+void test_resolve_path_too_long() {
+    char out[8];
+    CU_ASSERT_EQUAL(resolve_path("/abc", "def", out, sizeof(out)), -1);
+    CU_ASSERT_EQUAL(resolve_path("/abc", "de", out, sizeof(out)), 0);
+    CU_ASSERT_STRING_EQUAL(out, "/abc/de");
+    CU_ASSERT_EQUAL(resolve_path("/abc", "../xyz/..", out, sizeof(out)), 0);
+    CU_ASSERT_STRING_EQUAL(out, "/");
+}
@@ -0,0 +1,11 @@
+#ifndef WORKDIR_SUITE_H
+#define WORKDIR_SUITE_H
+
+#include "CUnit/Basic.h"
+#include "src/workdir.h"
+
+void test_resolve_relative_path();
+void test_resolve_absolute_path();
+void test_resolve_path_too_long();
+
+#endif